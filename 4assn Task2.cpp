@@ -1,9 +1,21 @@
 #include <GL/glew.h>
 #include <GL/glut.h>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
 #include <cstdlib>
 #include <iostream>
+#include <vector>
+
+#include "gl_program.h"
+#include "headless.h"
+#include "mesh_library.h"
+#include "pixel_readback.h"
+#include "ray_pick.h"
+#include "shape_meshes.h"
+#include "vec_math.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -22,40 +34,125 @@ float camCenterX = 0.0f, camCenterY = 0.0f, camCenterZ = 0.0f;
 
 bool useAA = true; 
 
-// Object diffuse colors (rgb)
-float objColor[3][3] = {
-    {0.8f, 0.2f, 0.2f}, // obj 0
-    {0.2f, 0.8f, 0.2f}, // obj 1
-    {0.2f, 0.2f, 0.8f}  // obj 2
-};
-
-// Unique pick colors
-unsigned char pickColorBytes[3][3] = {
-    { 10,  20,  30}, // id 0
-    { 40,  50,  60}, // id 1
-    { 70,  80,  90}  // id 2
-};
-
-
+// The scene: objectCount spheres, tori and teapots (-objects N, 3 by
+// default) on a lattice. Objects of one shape are numbered consecutively, so
+// each shape is a single instanced draw and the id of an object is the first
+// id of its shape plus gl_InstanceID.
+int objectCount = 3;
+int shapeFirst[4] = { 0, 1, 2, 3 };   // objects [shapeFirst[s], shapeFirst[s + 1]) are shape s
+vector<Mat4> objectModels;            // per object, uploaded once to instanceModelVBO
+vector<unsigned char> objColor;       // diffuse RGBA8 per object, mirrored in instanceColorVBO
+float camHome = 8.0f;                 // camera distance that frames the whole lattice
+
+// The scene is drawn into sceneFBO, lit color in attachment 0 and the
+// object id (id + 1, 0 for the background) in an R32UI attachment 1, in the
+// same pass. With anti-aliasing both are multisampled and the id of a picked
+// pixel is first blitted to pickFBO, which a single-sample read needs.
+GLuint sceneFBO = 0;
+GLuint sceneColorRB = 0, sceneIdRB = 0, sceneDepthRB = 0;
+int sceneSamples = 0;
+bool sceneAA = false; // useAA when sceneFBO was built
 GLuint pickFBO = 0;
-GLuint pickColorTex = 0;
-GLuint pickDepthRB = 0;
+GLuint pickIdRB = 0;
+
+// Fixed-function lighting of GL_LIGHT0, per vertex as before; the diffuse
+// color and model matrix come per instance, the rest of the material from
+// glMaterial. The model matrices are rigid, so they turn normals as they are.
+const char* sceneVsSrc = R"(
+#version 330 compatibility
+layout(location = 0) in vec3 inPos;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in mat4 inModel; // 2-5, per instance
+layout(location = 6) in vec4 inColor; // per instance
+uniform uint uFirstId;   // id of instance 0 of this draw
+uniform uint uHoveredId; // 0 for none
+out vec4 vColor;
+flat out uint vId;
+void main() {
+    vId = uFirstId + uint(gl_InstanceID);
+    vec4 world = inModel * vec4(inPos, 1.0);
+    vec3 P = vec3(gl_ModelViewMatrix * world);
+    vec3 N = normalize(mat3(gl_ModelViewMatrix) * (mat3(inModel) * inNormal));
+    vec4 lp = gl_LightSource[0].position;
+    vec3 L = normalize(lp.xyz - P * lp.w);
+    vec3 H = normalize(L + vec3(0.0, 0.0, 1.0)); // no local viewer
+    float diff = max(dot(N, L), 0.0);
+    float spec = diff > 0.0 ? pow(max(dot(N, H), 0.0), gl_FrontMaterial.shininess) : 0.0;
+    vec4 c = vec4(vec3(vId == uHoveredId ? 0.2 : 0.0), 0.0)
+           + (gl_LightModel.ambient + gl_LightSource[0].ambient) * gl_FrontMaterial.ambient
+           + diff * gl_LightSource[0].diffuse * inColor
+           + spec * gl_LightSource[0].specular * gl_FrontMaterial.specular;
+    vColor = vec4(clamp(c.rgb, 0.0, 1.0), inColor.a);
+    gl_Position = gl_ProjectionMatrix * vec4(P, 1.0);
+}
+)";
+
+const char* sceneFsSrc = R"(
+#version 330 compatibility
+in vec4 vColor;
+flat in uint vId;
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out uint outId;
+void main() {
+    outColor = vColor;
+    outId = vId;
+}
+)";
+
+GLProgram sceneProg;
+GLint locFirstId = -1, locHoveredId = -1;
+
+// The sphere, torus and teapot as triangle meshes (shape_meshes.h), built
+// once at a detail that suits the object count and kept as vertex-cache
+// ordered VBOs (mesh_library.h); drawn from them and ray-picked against
+// them, so both see the same surface. Each shape's VAO holds its mesh and
+// its slice of the per-instance buffers.
+MeshLibrary* shapes = nullptr;
+GLuint shapeVAO[3];
+GLuint instanceModelVBO = 0, instanceColorVBO = 0;
+
+// Picks never wait for the GPU: pickAt() and hoverAt() only queue a pixel,
+// display() reads the id under each queued pixel right after drawing into a
+// pixel pack buffer ring (pixel_readback.h), and the result is handled a
+// frame or so later when its fence has signalled
+struct PickRequest {
+    int x, y;
+    bool click; // randomizes the object's color; a hover only highlights it
+    int frame;  // for the latency figure of -headless
+};
+PixelReadback* pickReadback = nullptr;
+vector<PickRequest> pickQueue;
+int hoveredId = -1;
+int pickFrame = 0; // frames drawn so far
+long picksQueued = 0, picksDone = 0, pickLatencyFrames = 0;
+
+// Ray picking (ray_pick.h) answers a pick on the CPU right away, from the
+// camera and object transforms alone; 'c' switches between it and the id
+// buffer
+RayPicker rayPicker;
+bool useRayPick = true;
+long rayPicks = 0;
+double rayPickMicros = 0.0;
 
 // some helper
-void randizeObjectColor(int id) {
-    objColor[id][0] = 0.2f + 0.8f * (rand() / (float)RAND_MAX);
-    objColor[id][1] = 0.2f + 0.8f * (rand() / (float)RAND_MAX);
-    objColor[id][2] = 0.2f + 0.8f * (rand() / (float)RAND_MAX);
+void randizeObjectColor(int id, float lo = 0.2f) {
+    for (int c = 0; c < 3; c++)
+        objColor[id * 4 + c] = (unsigned char)(255.0f * (lo + (1.0f - lo) * (rand() / (float)RAND_MAX)) + 0.5f);
+    objColor[id * 4 + 3] = 255;
 }
 
-// Set camera and light 
-void setupCameraAndLight() {
-    glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    gluPerspective(55.0, (double)winW / (double)winH, 0.1, 100.0);
+// Pushes a changed color of object id to its instance
+void uploadObjectColor(int id) {
+    glBindBuffer(GL_ARRAY_BUFFER, instanceColorVBO);
+    glBufferSubData(GL_ARRAY_BUFFER, id * 4, 4, &objColor[id * 4]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+Mat4 cameraProjection() {
+    return perspective(55.0f, (float)winW / (float)winH, 0.1f, max(100.0f, 4.0f * camHome));
+}
+
+Mat4 cameraView() {
     // compute camera position
     float az = camAz * (float)M_PI / 180.0f;
     float el = camEl * (float)M_PI / 180.0f;
@@ -63,7 +160,100 @@ void setupCameraAndLight() {
     float camX = cx + camDist * cosf(el) * cosf(az);
     float camY = cy + camDist * sinf(el);
     float camZ = cz + camDist * cosf(el) * sinf(az);
-    gluLookAt(camX, camY, camZ, cx, cy, cz, 0.0f, 1.0f, 0.0f);
+    return lookAt(Vec3(camX, camY, camZ), Vec3(cx, cy, cz), Vec3(0, 1, 0));
+}
+
+// Lays out n objects, 2.2 apart on a lattice at least 3 wide and roughly a
+// cube, each tilted and turned; cell c holds shape c % 3. Three objects keep
+// the original row of sphere, torus and teapot.
+void buildScene(int n) {
+    objectCount = n;
+    int nx = max(3, (int)ceil(cbrt((double)n) - 1e-9));
+    int nz = n > nx ? min(nx, (n + nx - 1) / nx) : 1;
+    int ny = (n + nx * nz - 1) / (nx * nz);
+    objectModels.clear();
+    objColor.assign(n * 4, 255);
+    const unsigned char baseColor[3][3] = { { 204, 51, 51 }, { 51, 204, 51 }, { 51, 51, 204 } };
+    for (int s = 0; s < 3; s++) {
+        shapeFirst[s] = (int)objectModels.size();
+        for (int c = s; c < n; c += 3) {
+            int id = (int)objectModels.size();
+            float x = 2.2f * (c % nx - (nx - 1) * 0.5f);
+            float y = 2.2f * (c / (nx * nz) - (ny - 1) * 0.5f);
+            float z = 2.2f * (c / nx % nz - (nz - 1) * 0.5f);
+            objectModels.push_back(Mat4::translation(x, y, z) * rotation(-20.0f, Vec3(1, 0, 0)) *
+                                   rotation((float)(c % 12 * 30), Vec3(0, 1, 0)));
+            if (c < 3) memcpy(&objColor[id * 4], baseColor[s], 3);
+            else randizeObjectColor(id);
+        }
+    }
+    shapeFirst[3] = n;
+    camHome = max(8.0f, 2.64f * max(nx, max(ny, nz)));
+}
+
+// Builds the shape meshes, coarser for bigger scenes, uploads them and the
+// instance buffers, and hands the same meshes and transforms to the ray picker
+void buildSceneBuffers() {
+    int slices = objectCount <= 100 ? 48 : objectCount <= 10000 ? 16 : 8;
+    int teapotRes = objectCount <= 100 ? 10 : objectCount <= 10000 ? 4 : 2;
+    ModelMesh mesh;
+    shapes = new MeshLibrary();
+    makeSphereMesh(0.9f, slices, slices, mesh);
+    shapes->add("sphere", std::move(mesh));
+    makeTorusMesh(0.25f, 0.85f, slices, slices, mesh);
+    shapes->add("torus", std::move(mesh));
+    makeTeapotMesh(0.8f, teapotRes, mesh);
+    shapes->add("teapot", std::move(mesh));
+
+    glGenBuffers(1, &instanceModelVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceModelVBO);
+    glBufferData(GL_ARRAY_BUFFER, objectModels.size() * sizeof(Mat4), objectModels.data(), GL_STATIC_DRAW);
+    glGenBuffers(1, &instanceColorVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceColorVBO);
+    glBufferData(GL_ARRAY_BUFFER, objColor.size(), objColor.data(), GL_DYNAMIC_DRAW);
+
+    glGenVertexArrays(3, shapeVAO);
+    for (int s = 0; s < 3; s++) {
+        glBindVertexArray(shapeVAO[s]);
+        shapes->bind(s, 0, 1);
+
+        // instance 0 of this shape's draw is object shapeFirst[s]
+        glBindBuffer(GL_ARRAY_BUFFER, instanceModelVBO);
+        for (int col = 0; col < 4; col++) {
+            glEnableVertexAttribArray(2 + col);
+            glVertexAttribPointer(2 + col, 4, GL_FLOAT, GL_FALSE, sizeof(Mat4),
+                                  (void*)(shapeFirst[s] * sizeof(Mat4) + col * 4 * sizeof(float)));
+            glVertexAttribDivisor(2 + col, 1);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, instanceColorVBO);
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, 4, (void*)(size_t)(shapeFirst[s] * 4));
+        glVertexAttribDivisor(6, 1);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    int meshIds[3];
+    for (int s = 0; s < 3; s++) meshIds[s] = rayPicker.addMesh((*shapes)[s].mesh);
+    vector<PickInstance> instances(objectCount);
+    for (int s = 0; s < 3; s++)
+        for (int id = shapeFirst[s]; id < shapeFirst[s + 1]; id++) instances[id] = { meshIds[s], objectModels[id] };
+    rayPicker.setInstances(instances.data(), objectCount);
+}
+
+long trianglesPerFrame() {
+    long tris = 0;
+    for (int s = 0; s < 3; s++) tris += (long)((*shapes)[s].indexCount() / 3) * (shapeFirst[s + 1] - shapeFirst[s]);
+    return tris;
+}
+
+// Set camera and light 
+void setupCameraAndLight() {
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(cameraProjection().m);
+
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(cameraView().m);
 
     
     GLfloat lightPos[4] = { 0.0f, 0.0f, 0.0f, 1.0f }; 
@@ -79,186 +269,205 @@ void setupCameraAndLight() {
     glLightfv(GL_LIGHT0, GL_AMBIENT, lightAmbient);
 }
 
-// Draw the scene
-void drawScene(bool pickMode = false) {
-    
-    if (pickMode) {
-        glDisable(GL_LIGHTING);
-        glShadeModel(GL_FLAT);
-        glDisable(GL_DITHER);
-        glDisable(GL_POLYGON_SMOOTH);
-        glDisable(GL_BLEND);
+// Draw the scene, one instanced draw per shape; ids (id + 1) go to
+// attachment 1 of sceneFBO
+void drawScene() {
+    sceneProg.use();
+
+    GLfloat spec[4] = { 0.3f, 0.3f, 0.3f, 1.0f };
+    GLfloat ambient[4] = { 0.08f, 0.08f, 0.08f, 1.0f };
+    glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, spec);
+    glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, ambient);
+    glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, 32.0f);
+    glUniform1ui(locHoveredId, (GLuint)(hoveredId + 1));
+
+    for (int s = 0; s < 3; ++s) {
+        int count = shapeFirst[s + 1] - shapeFirst[s];
+        if (count == 0) continue;
+        glUniform1ui(locFirstId, (GLuint)(shapeFirst[s] + 1));
+        glBindVertexArray(shapeVAO[s]);
+        glDrawElementsInstanced(GL_TRIANGLES, (*shapes)[s].indexCount(), GL_UNSIGNED_INT, (void*)0, count);
     }
-    else {
-        glEnable(GL_LIGHTING);
-        glShadeModel(GL_SMOOTH);
-        glEnable(GL_DITHER);
-    }
-
-    // Common material settings when not in pick mode
-    for (int id = 0; id < 3; ++id) {
-        glPushMatrix();
-
-        if (id == 0) glTranslatef(-2.2f, 0.0f, 0.0f);
-        if (id == 1) glTranslatef(0.0f, 0.0f, 0.0f);
-        if (id == 2) glTranslatef(2.2f, 0.0f, 0.0f);
-
-        
-        glRotatef(-20.0f, 1.0f, 0.0f, 0.0f);
-        glRotatef((float)(id * 30), 0.0f, 1.0f, 0.0f);
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
 
-        if (pickMode) {
-            
-            glColor3ub(pickColorBytes[id][0], pickColorBytes[id][1], pickColorBytes[id][2]);
-            if (id == 0) glutSolidSphere(0.9, 48, 48);
-            else if (id == 1) glutSolidTorus(0.25, 0.85, 48, 48);
-            else glutSolidTeapot(0.8);
-        }
-        else {
-            
-            GLfloat diffuse[4] = { objColor[id][0], objColor[id][1], objColor[id][2], 1.0f };
-            GLfloat spec[4] = { 0.3f, 0.3f, 0.3f, 1.0f };
-            GLfloat ambient[4] = { 0.08f, 0.08f, 0.08f, 1.0f };
-            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, diffuse);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, spec);
-            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, ambient);
-            glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, 32.0f);
-
-            // draw primitive
-            if (id == 0) glutSolidSphere(0.9, 48, 48);
-            else if (id == 1) glutSolidTorus(0.25, 0.85, 48, 48);
-            else glutSolidTeapot(0.8);
-        }
 
-        glPopMatrix();
-    }
+GLuint sceneRenderbuffer(GLenum format, int w, int h, int samples) {
+    GLuint rb = 0;
+    glGenRenderbuffers(1, &rb);
+    glBindRenderbuffer(GL_RENDERBUFFER, rb);
+    glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, format, w, h);
+    return rb;
 }
 
+bool checkFramebuffer(const char* name) {
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status == GL_FRAMEBUFFER_COMPLETE) return true;
+    cerr << "ERROR: " << name << " FBO incomplete, status = 0x" << std::hex << status << std::dec << endl;
+    return false;
+}
 
-bool buildPickingFBO(int w, int h) {
+// (Re)builds sceneFBO, multisampled when anti-aliasing is on, and pickFBO
+bool buildSceneFBO(int w, int h) {
     // Delete old resources if present
-    if (pickFBO) {
-        glDeleteFramebuffers(1, &pickFBO);
-        pickFBO = 0;
-    }
-    if (pickColorTex) {
-        glDeleteTextures(1, &pickColorTex);
-        pickColorTex = 0;
-    }
-    if (pickDepthRB) {
-        glDeleteRenderbuffers(1, &pickDepthRB);
-        pickDepthRB = 0;
-    }
+    GLuint rbs[4] = { sceneColorRB, sceneIdRB, sceneDepthRB, pickIdRB };
+    glDeleteRenderbuffers(4, rbs);
+    if (sceneFBO) glDeleteFramebuffers(1, &sceneFBO);
+    if (pickFBO) glDeleteFramebuffers(1, &pickFBO);
+
+    // 4x, or less when integer color buffers allow fewer samples
+    GLint maxSamples = 0, maxIntSamples = 0;
+    glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    glGetIntegerv(GL_MAX_INTEGER_SAMPLES, &maxIntSamples);
+    sceneSamples = useAA ? min(4, min(maxSamples, maxIntSamples)) : 0;
+    sceneAA = useAA;
+
+    glGenFramebuffers(1, &sceneFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    sceneColorRB = sceneRenderbuffer(GL_RGBA8, w, h, sceneSamples);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sceneColorRB);
+    sceneIdRB = sceneRenderbuffer(GL_R32UI, w, h, sceneSamples);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_RENDERBUFFER, sceneIdRB);
+    sceneDepthRB = sceneRenderbuffer(GL_DEPTH_COMPONENT24, w, h, sceneSamples);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, sceneDepthRB);
+    bool ok = checkFramebuffer("Scene");
 
-    
     glGenFramebuffers(1, &pickFBO);
     glBindFramebuffer(GL_FRAMEBUFFER, pickFBO);
+    pickIdRB = sceneRenderbuffer(GL_R32UI, w, h, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, pickIdRB);
+    ok = checkFramebuffer("Picking") && ok;
 
-    // color texture (RGB8)
-    glGenTextures(1, &pickColorTex);
-    glBindTexture(GL_TEXTURE_2D, pickColorTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    // attach color texture
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pickColorTex, 0);
-
-    // depth renderbuffer
-    glGenRenderbuffers(1, &pickDepthRB);
-    glBindRenderbuffer(GL_RENDERBUFFER, pickDepthRB);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, pickDepthRB);
-
-    // set draw buffers
-    GLenum drawBufs[1] = { GL_COLOR_ATTACHMENT0 };
-    glDrawBuffers(1, drawBufs);
-    // read buffer also
-    glReadBuffer(GL_COLOR_ATTACHMENT0);
-
-    // Check completeness
-    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-    if (status != GL_FRAMEBUFFER_COMPLETE) {
-        cerr << "ERROR: Picking FBO incomplete, status = 0x" << std::hex << status << std::dec << endl;
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        return false;
-    }
-
-   
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    return true;
+    return ok;
 }
 
-void pickAt(int mx, int my) {
-    // Convert screen Y coordinate to OpenGL coordinates
-    int readY = winH - 1 - my;
-    unsigned char pixel[3] = { 0,0,0 };
-
-    glBindFramebuffer(GL_FRAMEBUFFER, pickFBO);
-    glViewport(0, 0, winW, winH);
-
-    glClearColor(0, 0, 0, 1);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-
-    setupCameraAndLight();
-
-    drawScene(true);
+// What a resolved pick does: a hover highlights, a click recolors
+void handlePick(const PickRequest& req, int picked, const RayHit* hit) {
+    if (!req.click) {
+        hoveredId = picked;
+        return;
+    }
 
-    glFlush();
-    glFinish();
+    // a headless run picks every few frames; keep its output to the report
+    bool verbose = !headless().active();
+    if (verbose && hit && picked >= 0)
+        std::cout << "Ray hit at (" << hit->position.x << ", " << hit->position.y << ", " << hit->position.z << ")\n";
 
-    // Ensure we read from the color attachment
-    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    if (picked >= 0) {
+        // Randomize color of picked object 
+        randizeObjectColor(picked, 0.0f);
+        uploadObjectColor(picked);
 
-   
-    glReadPixels(mx, readY, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, pixel);
+        if (verbose) std::cout << "Picked object " << picked
+            << " new color = ("
+            << objColor[picked * 4] / 255.0f << ", "
+            << objColor[picked * 4 + 1] / 255.0f << ", "
+            << objColor[picked * 4 + 2] / 255.0f << ")\n";
+    }
+}
 
-    
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Called from pickReadback->poll() with the id under a queued pick
+void pickResolved(const PickRequest& req, const unsigned char* pixel) {
+    picksDone++;
+    pickLatencyFrames += pickFrame - req.frame;
+    GLuint stored = 0;
+    memcpy(&stored, pixel, sizeof(stored));
+    if (stored > (GLuint)objectCount) stored = 0; // not an id we wrote; treat as background
+    if (req.click && !headless().active()) std::cout << "Picked id = " << stored << "\n";
+    handlePick(req, (int)stored - 1, nullptr); // -1 for the background
+}
 
-    
-    std::cout << "Picked color = ("
-        << (int)pixel[0] << ", "
-        << (int)pixel[1] << ", "
-        << (int)pixel[2] << ")\n";
+void rayPick(const PickRequest& req) {
+    auto start = std::chrono::steady_clock::now();
+    RayHit hit = rayPicker.pick(screenRay(cameraProjection(), cameraView(), (float)req.x, (float)req.y, winW, winH));
+    rayPickMicros += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    rayPicks++;
+    handlePick(req, hit.instance, &hit);
+}
 
-    // Identify which object was clicked
-    int picked = -1;
-    if (pixel[0] == pickColorBytes[0][0] && pixel[1] == pickColorBytes[0][1] && pixel[2] == pickColorBytes[0][2]) picked = 0;
-    else if (pixel[0] == pickColorBytes[1][0] && pixel[1] == pickColorBytes[1][1] && pixel[2] == pickColorBytes[1][2]) picked = 1;
-    else if (pixel[0] == pickColorBytes[2][0] && pixel[1] == pickColorBytes[2][1] && pixel[2] == pickColorBytes[2][2]) picked = 2;
+void pickAt(int mx, int my) {
+    if (useRayPick) {
+        rayPick({ mx, my, true, pickFrame });
+        return;
+    }
+    pickQueue.push_back({ mx, my, true, pickFrame });
+    picksQueued++;
+}
 
-    if (picked >= 0) {
-        // Randomize color of picked object 
-        objColor[picked][0] = (float)rand() / RAND_MAX;
-        objColor[picked][1] = (float)rand() / RAND_MAX;
-        objColor[picked][2] = (float)rand() / RAND_MAX;
+// Only the latest hover position is worth reading
+void hoverAt(int mx, int my) {
+    if (useRayPick) {
+        rayPick({ mx, my, false, pickFrame });
+        return;
+    }
+    for (PickRequest& req : pickQueue)
+        if (!req.click) {
+            req = { mx, my, false, pickFrame };
+            return;
+        }
+    pickQueue.push_back({ mx, my, false, pickFrame });
+    picksQueued++;
+}
 
-        std::cout << "Picked object " << picked
-            << " new color = ("
-            << objColor[picked][0] << ", "
-            << objColor[picked][1] << ", "
-            << objColor[picked][2] << ")\n";
+// Starts the readbacks of the ids under the queued picks, 4 bytes each; a
+// pick that finds the ring full stays queued for the next frame
+void readPickIds() {
+    // a pick queued before the window shrank may lie outside the framebuffer,
+    // where a read leaves the buffer's contents undefined
+    size_t inside = 0;
+    for (const PickRequest& req : pickQueue)
+        if (req.x >= 0 && req.x < winW && req.y >= 0 && req.y < winH) pickQueue[inside++] = req;
+    pickQueue.resize(inside);
+    if (pickQueue.empty()) return;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+    glReadBuffer(GL_COLOR_ATTACHMENT1);
+    if (sceneSamples > 0) {
+        // resolve just the queued pixels; integer samples resolve to one of them
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, pickFBO);
+        for (const PickRequest& req : pickQueue) {
+            int x = req.x, y = winH - 1 - req.y;
+            glBlitFramebuffer(x, y, x + 1, y + 1, x, y, x + 1, y + 1, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        }
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, pickFBO);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+    }
 
-       
-        glutPostRedisplay();
+    size_t waiting = 0;
+    for (const PickRequest& req : pickQueue) {
+        // Convert screen Y coordinate to OpenGL coordinates
+        int readY = winH - 1 - req.y;
+        auto done = [req](const unsigned char* pixel) { pickResolved(req, pixel); };
+        if (!pickReadback->read(req.x, readY, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_INT, 4, done))
+            pickQueue[waiting++] = req;
     }
+    pickQueue.resize(waiting);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void display() {
-   
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, winW, winH);
+    // picks whose pixels have arrived; may recolor or highlight an object
+    pickReadback->poll();
 
-    if (useAA) glEnable(GL_MULTISAMPLE);
-    else glDisable(GL_MULTISAMPLE);
+    if (sceneAA != useAA) buildSceneFBO(winW, winH);
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneFBO);
+    glViewport(0, 0, winW, winH);
 
-    glClearColor(0.12f, 0.12f, 0.12f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    const GLenum colorOnly[1] = { GL_COLOR_ATTACHMENT0 };
+    const GLenum colorAndId[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+    const GLfloat background[4] = { 0.12f, 0.12f, 0.12f, 1.0f };
+    const GLuint noObject[4] = { 0, 0, 0, 0 };
+    glDrawBuffers(2, colorAndId);
+    glClearBufferfv(GL_COLOR, 0, background);
+    glClearBufferuiv(GL_COLOR, 1, noObject);
+    glClear(GL_DEPTH_BUFFER_BIT);
 
     setupCameraAndLight();
 
-    // draw axes at center for reference
+    // draw axes at center for reference, color only so they keep the background id
+    glDrawBuffers(1, colorOnly);
     glPushMatrix();
     glTranslatef(camCenterX, camCenterY, camCenterZ);
     glDisable(GL_LIGHTING);
@@ -270,8 +479,17 @@ void display() {
     glEnd();
     glPopMatrix();
 
-    
-    drawScene(false);
+    glDrawBuffers(2, colorAndId);
+    drawScene();
+
+    readPickIds();
+
+    // lit color to the window, resolving the samples; the HUD goes on top
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, headless().framebuffer());
+    glBlitFramebuffer(0, 0, winW, winH, 0, 0, winW, winH, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless().framebuffer());
 
     // HUD
     glMatrixMode(GL_PROJECTION);
@@ -283,23 +501,29 @@ void display() {
     glLoadIdentity();
     glDisable(GL_LIGHTING);
     glColor3f(1, 1, 1);
-    string hud = "AA: (a) toggle     Click to pick object     Camera: arrow keys (rotate), w/s zoom, r reset";
+    string hud = "AA: (a) toggle     Click to pick object, hover to highlight, (c) CPU/GPU picking     Camera: arrow keys (rotate), w/s zoom, r reset";
     glRasterPos2i(8, winH - 18);
-    for (char c : hud) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, c);
+    if (!headless().active()) // GLUT's bitmap font needs a GLUT window
+        for (char c : hud) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, c);
     glPopMatrix();
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
     glMatrixMode(GL_MODELVIEW);
 
-    glutSwapBuffers();
+    pickFrame++;
+    if (!headless().active()) {
+        glutSwapBuffers();
+        // keep drawing until the picks in flight are resolved
+        if (pickReadback->pending() > 0 || !pickQueue.empty()) glutPostRedisplay();
+    }
 }
 
 void reshape(int w, int h) {
     winW = max(1, w);
     winH = max(1, h);
     
-    if (!buildPickingFBO(winW, winH)) {
-        cerr << "Failed to (re)build picking FBO\n";
+    if (!buildSceneFBO(winW, winH)) {
+        cerr << "Failed to (re)build scene FBO\n";
     }
     glViewport(0, 0, winW, winH);
     glutPostRedisplay();
@@ -309,7 +533,7 @@ void keyboard(unsigned char key, int x, int y) {
     switch (key) {
     case 27: case 'q': exit(0); break;
     case 'r':
-        camAz = 30.0f; camEl = 10.0f; camDist = 8.0f;
+        camAz = 30.0f; camEl = 10.0f; camDist = camHome;
         camCenterX = camCenterY = camCenterZ = 0.0f;
         break;
     case 'a':
@@ -317,11 +541,15 @@ void keyboard(unsigned char key, int x, int y) {
         cout << "Anti-aliasing " << (useAA ? "ON" : "OFF") << "\n";
         break;
     case 'w':
-        camDist = fmaxf(1.0f, camDist - 0.4f); break;
+        camDist = fmaxf(1.0f, camDist - camHome / 20.0f); break;
     case 's':
-        camDist = fminf(50.0f, camDist + 0.4f); break;
+        camDist = fminf(6.25f * camHome, camDist + camHome / 20.0f); break;
+    case 'c':
+        useRayPick = !useRayPick;
+        cout << "Picking: " << (useRayPick ? "CPU ray cast" : "GPU id buffer") << "\n";
+        break;
     case 'p': 
-        for (int i = 0;i < 3;i++) cout << "obj " << i << " color = " << objColor[i][0] << ", " << objColor[i][1] << ", " << objColor[i][2] << "\n";
+        for (int i = 0;i < min(objectCount, 10);i++) cout << "obj " << i << " color = " << objColor[i * 4] / 255.0f << ", " << objColor[i * 4 + 1] / 255.0f << ", " << objColor[i * 4 + 2] / 255.0f << "\n";
         break;
     }
     glutPostRedisplay();
@@ -340,9 +568,15 @@ void specialKey(int key, int x, int y) {
 void mouse(int button, int state, int x, int y) {
     if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {
         pickAt(x, y);
+        glutPostRedisplay();
     }
 }
 
+void passiveMotion(int x, int y) {
+    hoverAt(x, y);
+    glutPostRedisplay();
+}
+
 // init GL states
 void initGL() {
     glEnable(GL_DEPTH_TEST);
@@ -351,34 +585,86 @@ void initGL() {
     glDisable(GL_COLOR_MATERIAL);
 
     
-    if (!buildPickingFBO(winW, winH)) {
+    if (!sceneProg.build({ { GL_VERTEX_SHADER, sceneVsSrc }, { GL_FRAGMENT_SHADER, sceneFsSrc } })) exit(1);
+    locFirstId = sceneProg.uniform("uFirstId");
+    locHoveredId = sceneProg.uniform("uHoveredId");
+    if (!buildSceneFBO(winW, winH)) {
         cerr << "Initial FBO build failed\n";
     }
+    pickReadback = new PixelReadback();
+
     srand((unsigned int)time(NULL));
+    buildScene(objectCount);
+    buildSceneBuffers();
+    camDist = camHome;
+}
+
+// Scripted input for -headless: the camera orbits and zooms, anti-aliasing
+// flips every 50 frames, the mouse hovers over a point sweeping across the
+// middle of the window every frame and every 10th frame clicks at another,
+// so the pick readbacks are timed too. Every other 100 frames pick by ray
+// instead.
+void headlessScript(int frame, int frames) {
+    camAz = 30.0f + 360.0f * frame / frames;
+    camEl = 10.0f + 20.0f * sinf(frame * 0.05f);
+    camDist = camHome * (1.0f + 0.25f * sinf(frame * 0.03f));
+    useAA = frame / 50 % 2 == 0;
+    useRayPick = frame / 100 % 2 == 1;
+    hoverAt(winW * (1 + frame % 80) / 82, winH / 2);
+    if (frame % 10 == 0) pickAt(winW * (2 + frame / 10 % 7) / 10, winH / 2);
 }
 
 int main(int argc, char** argv) {
-    glutInit(&argc, argv);
-   
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH | GLUT_MULTISAMPLE);
-    glutInitWindowSize(winW, winH);
-    glutCreateWindow("Part 2 ");
+    bool offscreen = headless().parse(argc, argv);
+    if (offscreen) {
+        if (!headless().createContext()) return 1;
+    }
+    else {
+        glutInit(&argc, argv);
+
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
+        glutInitWindowSize(winW, winH);
+        glutCreateWindow("Part 2 ");
+    }
+
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "-objects") == 0 && i + 1 < argc) objectCount = max(1, atoi(argv[++i]));
 
     GLenum err = glewInit();
-    if (GLEW_OK != err) {
+    if (!glewInitOk(err)) {
         cerr << "Error: GLEW init failed: " << glewGetErrorString(err) << endl;
         return 1;
     }
 
     initGL();
 
+    if (offscreen) {
+        if (!headless().createTarget(winW, winH)) return 1;
+        while (headless().nextFrame()) {
+            headlessScript(headless().frame(), headless().frameCount());
+            display();
+        }
+        headless().report("Task2");
+        printf("  scene: %d objects, %ld triangles per frame\n", objectCount, trianglesPerFrame());
+        shapes->report();
+        printf("  picks: %ld queued, %ld resolved, %.2f frames from request to result\n", picksQueued, picksDone,
+               picksDone ? (double)pickLatencyFrames / picksDone : 0.0);
+        printf("  ray picks: %ld, %.2f us each\n", rayPicks, rayPicks ? rayPickMicros / rayPicks : 0.0);
+        headless().destroy();
+        return 0;
+    }
+
     glutDisplayFunc(display);
     glutReshapeFunc(reshape);
     glutKeyboardFunc(keyboard);
     glutSpecialFunc(specialKey);
     glutMouseFunc(mouse);
+    glutPassiveMotionFunc(passiveMotion);
 
-    cout << "Controls:\n  Arrow keys: rotate camera\n  w/s: zoom  r: reset\n  a: toggle anti-aliasing\n  Click left mouse on objects to pick and randomize their color.\n";
+    cout << "Controls:\n  Arrow keys: rotate camera\n  w/s: zoom  r: reset\n  a: toggle anti-aliasing  c: pick by CPU ray cast or GPU id buffer\n  Click left mouse on objects to pick and randomize their color; hovering highlights them.\n"
+         << "Run with -objects N for a scene of N objects (3 by default), instanced per shape.\n"
+         << "Run with -headless [frames] to benchmark a scripted run offscreen without a window.\n";
+    shapes->report();
 
     glutMainLoop();
     return 0;
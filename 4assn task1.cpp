@@ -1,5 +1,7 @@
+#include <GL/glew.h>
 #include <GL/glut.h>
 #include <cmath>
+#include <cstdint>
 #include <vector>
 #include <cstdio>
 #include <cstdlib>
@@ -7,39 +9,31 @@
 #include <iostream>
 #include <fstream>
 
+#include "bezier_simd.h"
+#include "job_pool.h"
+#include "bezier_adaptive.h"
+#include "bezier_model.h"
+#include "mesh_cache.h"
+#include "gl_program.h"
+#include "headless.h"
+#include "vec_math.h"
+
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
 using namespace std;
 
-struct Vec3 {
-    float x, y, z;
-    Vec3() :x(0), y(0), z(0) {}
-    Vec3(float X, float Y, float Z) :x(X), y(Y), z(Z) {}
-    Vec3 operator+(const Vec3& o) const { return Vec3(x + o.x, y + o.y, z + o.z); }
-    Vec3 operator-(const Vec3& o) const { return Vec3(x - o.x, y - o.y, z - o.z); }
-    Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
-};
-
-static inline Vec3 crossp(const Vec3& a, const Vec3& b) {
-    return Vec3(a.y * b.z - a.z * b.y,
-        a.z * b.x - a.x * b.z,
-        a.x * b.y - a.y * b.x);
-}
-static inline float dotp(const Vec3& a, const Vec3& b) {
-    return a.x * b.x + a.y * b.y + a.z * b.z;
-}
-static inline float len(const Vec3& v) { return sqrtf(dotp(v, v)); }
-static inline Vec3 normalize(const Vec3& v) {
-    float L = len(v);
-    if (L == 0.0f) return Vec3(0, 0, 1);
-    return v * (1.0f / L);
-}
+// Degenerate triangles (collapsed patch edges) light as if facing +z
+static inline Vec3 unitOrZ(const Vec3& v) { return normalize(v, Vec3(0, 0, 1)); }
 
 // Control points
 Vec3 ctrl[4][4];
 
+// Multi-patch model given on the command line (.bpt); when it is loaded it is
+// drawn instead of ctrl, and control point editing is off
+BezierModel patchModel;
+
 int selectedIndex = 0; // 0..15
 
 int res = 10; // initial 10x10 resolution
@@ -57,12 +51,47 @@ struct Tri {
 };
 vector<Tri> triangles;
 
+// Surface samples kept between rebuilds, [v * (meshRes + 1) + u], plus the
+// Bernstein weights of every grid column/row. The patch is linear in ctrl, so
+// moving ctrl[cx][cy] by d moves sample (u,v) by basisU[u][cx]*basisV[v][cy]*d.
+vector<Vec3> gridPts;
+vector<float> basisU, basisV; // (meshRes + 1) * 4 each
+int meshRes = -1;
+
+// Retained-mode renderer: the current mesh as shared vertices in a VBO plus
+// a triangle index list, drawn with one glDrawElements and lit in a shader.
+// The uniform grid draws gridPts directly; model and adaptive meshes keep
+// their welded vertices in meshPts. `triangles` stays the immediate-mode
+// fallback when shaders are unavailable.
+vector<Vec3> meshPts;
+vector<unsigned int> meshInds;
+bool retainedOk = false, useRetained = true;
+GLuint meshVbo = 0, meshEbo = 0;
+GLProgram flatProg;
+GLint locLightPos = -1, locLightColor = -1, locKd = -1, locAmbient = -1;
+bool meshUploadAll = true; // sizes or indices changed since the last upload
+// The grid changed while the retained renderer drew it from gridPts alone;
+// `triangles` is rebuilt before the immediate-mode path next draws it
+bool trianglesStale = false;
+
+// gridPts range touched by the last edit; only [dirtyPtBegin, dirtyPtEnd) is
+// re-sent to the VBO
+size_t dirtyPtBegin = SIZE_MAX, dirtyPtEnd = 0;
+
+// Screen-space adaptive tessellation (toggle: t). Rebuilt whenever the camera
+// or the control points change; `res` is ignored while it is on.
+bool useAdaptive = false;
+const float adaptivePixelTol = 1.0f;
+bool adaptiveDirty = true;
+float adaptiveKey[4] = { 0, 0, 0, 0 }; // eye + viewport height of the last build
+
 // material and light
 Vec3 lightColor = Vec3(1.0f, 1.0f, 1.0f);
 Vec3 kd = Vec3(0.7f, 0.5f, 0.2f); 
 
 
 Vec3 patchCenter(0, 0, 0);
+float defaultCamDist = 6.0f;
 
 bool loadControlPointsFromFile(const char* fname) {
     ifstream in(fname);
@@ -101,6 +130,18 @@ void setDefaultControlPoints() {
 }
 
 void computePatchCenter() {
+    if (patchModel.patchCount > 0) {
+        // bounding box centre of all control points
+        Vec3 lo(1e30f, 1e30f, 1e30f), hi(-1e30f, -1e30f, -1e30f);
+        for (size_t k = 0; k < patchModel.ctrl.size(); k += 3) {
+            const float* c = &patchModel.ctrl[k];
+            lo = Vec3(fminf(lo.x, c[0]), fminf(lo.y, c[1]), fminf(lo.z, c[2]));
+            hi = Vec3(fmaxf(hi.x, c[0]), fmaxf(hi.y, c[1]), fmaxf(hi.z, c[2]));
+        }
+        patchCenter = (lo + hi) * 0.5f;
+        defaultCamDist = max(6.0f, 1.5f * length(hi - lo));
+        return;
+    }
     Vec3 sum(0, 0, 0);
     for (int i = 0;i < 4;i++) for (int j = 0;j < 4;j++) sum = sum + ctrl[i][j];
     patchCenter = sum * (1.0f / 16.0f);
@@ -135,43 +176,261 @@ Vec3 evaluatePatchPt(float u, float v) {
 }
 
 // Build mesh (triangles) 
-void buildMesh() {
-    triangles.clear();
-    int N = res;
-    
-    vector<vector<Vec3>> grid(N + 1, vector<Vec3>(N + 1));
-    for (int v = 0; v <= N; v++) {
-        float fv = (float)v / (float)N;
-        for (int u = 0; u <= N; u++) {
-            float fu = (float)u / (float)N;
-            grid[u][v] = evaluatePatchPt(fu, fv);
+// ctrl in the structure-of-arrays layout of bezier_simd.h
+PatchSoA ctrlSoA() {
+    PatchSoA p;
+    for (int i = 0;i < 4;i++) {
+        for (int j = 0;j < 4;j++) {
+            p.x[i * 4 + j] = ctrl[i][j].x;
+            p.y[i * 4 + j] = ctrl[i][j].y;
+            p.z[i * 4 + j] = ctrl[i][j].z;
         }
     }
+    return p;
+}
 
-    // create triangles: each cell two triangles
-    for (int v = 0; v < N; v++) {
+// Rebuilds the two triangles of every cell in rows [v0, v1) from gridPts
+void buildTriRows(int v0, int v1) {
+    int N = meshRes;
+    for (int v = v0; v < v1; v++) {
+        Tri* out = triangles.data() + (size_t)v * N * 2;
+        const Vec3* r0 = gridPts.data() + (size_t)v * (N + 1);
+        const Vec3* r1 = r0 + (N + 1);
         for (int u = 0; u < N; u++) {
-            Vec3 p00 = grid[u][v];
-            Vec3 p10 = grid[u + 1][v];
-            Vec3 p01 = grid[u][v + 1];
-            Vec3 p11 = grid[u + 1][v + 1];
+            Vec3 p00 = r0[u];
+            Vec3 p10 = r0[u + 1];
+            Vec3 p01 = r1[u];
+            Vec3 p11 = r1[u + 1];
             // triangle 1
-            Tri t1;
+            Tri& t1 = out[u * 2];
             t1.v0 = p00; t1.v1 = p10; t1.v2 = p11;
             Vec3 e1 = t1.v1 - t1.v0;
             Vec3 e2 = t1.v2 - t1.v0;
-            t1.normal = normalize(crossp(e1, e2));
+            t1.normal = unitOrZ(crossp(e1, e2));
             // triangle 2
-            Tri t2;
+            Tri& t2 = out[u * 2 + 1];
             t2.v0 = p00; t2.v1 = p11; t2.v2 = p01;
             e1 = t2.v1 - t2.v0;
             e2 = t2.v2 - t2.v0;
-            t2.normal = normalize(crossp(e1, e2));
-            triangles.push_back(t1);
-            triangles.push_back(t2);
+            t2.normal = unitOrZ(crossp(e1, e2));
         }
     }
-    
+}
+
+// Takes over an indexed mesh (xyz per vertex) that is not the uniform grid,
+// and expands it into `triangles` for the immediate-mode path
+void setIndexedMesh(const float* pos, size_t vertexCount, vector<unsigned int>& inds) {
+    meshPts.resize(vertexCount);
+    for (size_t k = 0; k < vertexCount; k++) meshPts[k] = Vec3(pos[k * 3], pos[k * 3 + 1], pos[k * 3 + 2]);
+    meshInds.swap(inds);
+    triangles.resize(meshInds.size() / 3);
+    for (size_t t = 0; t < triangles.size(); t++) {
+        const unsigned int* id = &meshInds[t * 3];
+        Tri& tri = triangles[t];
+        tri.v0 = meshPts[id[0]];
+        tri.v1 = meshPts[id[1]];
+        tri.v2 = meshPts[id[2]];
+        tri.normal = unitOrZ(crossp(tri.v1 - tri.v0, tri.v2 - tri.v0));
+    }
+    meshRes = -1; // no single-patch grid to update incrementally
+    trianglesStale = false;
+    meshUploadAll = true;
+}
+
+// Every patch of patchModel at res x res cells, welded (bezier_model.h). The
+// indexed mesh is cached on disk per model and res (mesh_cache.h), so going
+// back to a resolution seen before is a file read instead of a tessellation.
+// The single editable patch changes with every key press and is not cached.
+const uint32_t MODEL_LAYOUT = meshLayoutTag('P', 'I', 'X', '1'); // xyz per vertex + indices
+
+void buildModelMesh() {
+    uint64_t key = meshCacheKey(patchModel.ctrl.data(), patchModel.ctrl.size(), res, MODEL_LAYOUT);
+    string path = meshCachePath(key);
+    MappedMesh file;
+    if (file.open(path, key, MODEL_LAYOUT, 3 * sizeof(float))) {
+        vector<unsigned int> inds(file.indices(), file.indices() + file.indexCount());
+        setIndexedMesh((const float*)file.vertices(), file.vertexBytes() / (3 * sizeof(float)), inds);
+        return;
+    }
+
+    ModelMesh m;
+    tessellateModel(patchModel, res + 1, m);
+    if (!writeMeshCache(path, key, MODEL_LAYOUT, 3 * sizeof(float), m.pos.data(), m.vertexCount(),
+                        m.inds.data(), m.inds.size()))
+        cerr << "Could not write mesh cache " << path << "\n";
+    setIndexedMesh(m.pos.data(), m.vertexCount(), m.inds);
+}
+
+// Grid rows are evaluated and triangulated on the job pool. Every row writes
+// into its own preallocated slice of gridPts and of triangles, so the mesh
+// is the same whatever the thread count.
+void buildMesh() {
+    if (patchModel.patchCount > 0) { buildModelMesh(); return; }
+    int N = res;
+    JobPool& pool = jobPool();
+    PatchSoA p = ctrlSoA();
+
+    // cache the per-column/per-row weights for incremental edits
+    meshRes = N;
+    basisU.resize((N + 1) * 4);
+    for (int k = 0; k <= N; k++) bernstein3((float)k / (float)N, &basisU[k * 4]);
+    basisV = basisU;
+
+    // evaluate the (N+1)^2 grid points as SoA batches (SIMD when available)
+    int M = (N + 1) * (N + 1);
+    vector<float> us(M), vs(M), px(M), py(M), pz(M);
+    gridPts.resize(M);
+    pool.parallelFor(0, N + 1, pool.grainFor(N + 1), [&](int v0, int v1) {
+        int k0 = v0 * (N + 1), k1 = v1 * (N + 1);
+        for (int v = v0; v < v1; v++) {
+            for (int u = 0; u <= N; u++) {
+                us[v * (N + 1) + u] = (float)u / (float)N;
+                vs[v * (N + 1) + u] = (float)v / (float)N;
+            }
+        }
+        PatchSamples s = { px.data() + k0, py.data() + k0, pz.data() + k0, nullptr, nullptr, nullptr };
+        evalPatchBatch(p, us.data() + k0, vs.data() + k0, k1 - k0, s);
+        for (int k = k0; k < k1; k++) gridPts[k] = Vec3(px[k], py[k], pz[k]);
+    });
+
+    // create triangles: each cell two triangles
+    triangles.resize((size_t)N * N * 2);
+    trianglesStale = retainedOk && useRetained;
+    if (!trianglesStale) pool.parallelFor(0, N, pool.grainFor(N), [&](int v0, int v1) { buildTriRows(v0, v1); });
+
+    // the same two triangles per cell as indices into gridPts
+    meshInds.resize((size_t)N * N * 6);
+    for (int v = 0; v < N; v++) {
+        for (int u = 0; u < N; u++) {
+            unsigned int i00 = v * (N + 1) + u, i10 = i00 + 1, i01 = i00 + N + 1, i11 = i01 + 1;
+            unsigned int* out = &meshInds[((size_t)v * N + u) * 6];
+            out[0] = i00; out[1] = i10; out[2] = i11;
+            out[3] = i00; out[4] = i11; out[5] = i01;
+        }
+    }
+    meshUploadAll = true;
+    adaptiveDirty = true; // triangles now hold the uniform grid
+}
+
+// Replaces triangles with a screen-space adaptive tessellation for this eye
+void buildAdaptiveMesh(const Vec3& eye, int winH) {
+    float key[4] = { eye.x, eye.y, eye.z, (float)winH };
+    if (!adaptiveDirty && equal(key, key + 4, adaptiveKey)) return;
+    copy(key, key + 4, adaptiveKey);
+    adaptiveDirty = false;
+
+    AdaptiveView view = { { eye.x, eye.y, eye.z }, winH / (2.0f * tanf(45.0f * (float)M_PI / 360.0f)), adaptivePixelTol };
+    AdaptiveMesh m;
+    tessellateAdaptive(ctrlSoA(), view, m);
+    setIndexedMesh(m.pos.data(), m.pos.size() / 3, m.inds); // the cached grid no longer matches
+}
+
+// Applies a move of ctrl[cx][cy] by d to the cached mesh without evaluating
+// the patch again: one weighted add per affected sample, then, unless the
+// retained renderer draws straight from gridPts, the triangles of the
+// affected rows get new positions and face normals. Nothing is reallocated.
+void updateMeshForControlPoint(int cx, int cy, const Vec3& d) {
+    int N = meshRes;
+    JobPool& pool = jobPool();
+
+    // rows/columns where the weight is non-zero (Bernstein end weights vanish
+    // on the opposite border)
+    int vLo = N + 1, vHi = -1;
+    for (int v = 0; v <= N; v++) {
+        if (basisV[v * 4 + cy] != 0.0f) { vLo = min(vLo, v); vHi = v; }
+    }
+    if (vHi < 0) return;
+
+    pool.parallelFor(vLo, vHi + 1, pool.grainFor(vHi + 1 - vLo), [&](int v0, int v1) {
+        for (int v = v0; v < v1; v++) {
+            Vec3 dv = d * basisV[v * 4 + cy];
+            Vec3* row = gridPts.data() + (size_t)v * (N + 1);
+            for (int u = 0; u <= N; u++) row[u] = row[u] + dv * basisU[u * 4 + cx];
+        }
+    });
+
+    // cells touching a moved sample
+    int c0 = max(0, vLo - 1), c1 = min(N, vHi + 1);
+    if (retainedOk && useRetained) trianglesStale = true;
+    else if (!trianglesStale)
+        pool.parallelFor(c0, c1, pool.grainFor(c1 - c0), [&](int v0, int v1) { buildTriRows(v0, v1); });
+    dirtyPtBegin = min(dirtyPtBegin, (size_t)vLo * (N + 1));
+    dirtyPtEnd = max(dirtyPtEnd, (size_t)(vHi + 1) * (N + 1));
+}
+
+// GLSL 1.20 on top of the fixed-function matrices. The face normal comes from
+// screen-space derivatives of the world position, so the shared vertices need
+// no normals and the result is the same flat Lambert term as the CPU path; it
+// always faces the viewer and is flipped for back faces, as the winding
+// normal would be.
+const char* flatVsSrc = R"(
+#version 120
+varying vec3 vWorld;
+void main(){
+    vWorld = gl_Vertex.xyz;
+    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+})";
+
+const char* flatFsSrc = R"(
+#version 120
+varying vec3 vWorld;
+uniform vec3 uLightPos, uLightColor, uKd, uAmbient;
+void main(){
+    vec3 N = normalize(cross(dFdx(vWorld), dFdy(vWorld)));
+    if (!gl_FrontFacing) N = -N;
+    vec3 L = normalize(uLightPos - vWorld);
+    vec3 col = uKd * uLightColor * max(dot(N, L), 0.0) + vec3(uAmbient);
+    gl_FragColor = vec4(min(col, vec3(1.0)), 1.0);
+})";
+
+// Sets up the retained path; false leaves the immediate-mode renderer on
+bool initRetained() {
+    if (!glewInitOk(glewInit()) || !GLEW_VERSION_2_0) return false;
+    // GL 2.x has no uniform blocks; the four uniforms are looked up once
+    if (!flatProg.build({ { GL_VERTEX_SHADER, flatVsSrc }, { GL_FRAGMENT_SHADER, flatFsSrc } })) return false;
+    locLightPos = flatProg.uniform("uLightPos");
+    locLightColor = flatProg.uniform("uLightColor");
+    locKd = flatProg.uniform("uKd");
+    locAmbient = flatProg.uniform("uAmbient");
+    glGenBuffers(1, &meshVbo);
+    glGenBuffers(1, &meshEbo);
+    return true;
+}
+
+// Brings the VBO up to date: everything after a rebuild, otherwise only the
+// rows the last control-point edits moved
+void syncMeshBuffers() {
+    const vector<Vec3>& pts = meshRes >= 0 ? gridPts : meshPts;
+    glBindBuffer(GL_ARRAY_BUFFER, meshVbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshEbo);
+    if (meshUploadAll) {
+        glBufferData(GL_ARRAY_BUFFER, pts.size() * sizeof(Vec3), pts.data(), GL_DYNAMIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, meshInds.size() * sizeof(unsigned int), meshInds.data(), GL_STATIC_DRAW);
+        meshUploadAll = false;
+    }
+    else if (dirtyPtEnd > dirtyPtBegin) {
+        glBufferSubData(GL_ARRAY_BUFFER, dirtyPtBegin * sizeof(Vec3), (dirtyPtEnd - dirtyPtBegin) * sizeof(Vec3),
+                        pts.data() + dirtyPtBegin);
+    }
+    dirtyPtBegin = SIZE_MAX;
+    dirtyPtEnd = 0;
+}
+
+void drawMeshRetained(const Vec3& lightPos) {
+    syncMeshBuffers();
+    flatProg.use();
+    glUniform3f(locLightPos, lightPos.x, lightPos.y, lightPos.z);
+    glUniform3f(locLightColor, lightColor.x, lightColor.y, lightColor.z);
+    glUniform3f(locKd, kd.x, kd.y, kd.z);
+    glUniform3f(locAmbient, 0.08f, 0.08f, 0.08f);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(Vec3), (void*)0);
+    glDrawElements(GL_TRIANGLES, (GLsizei)meshInds.size(), GL_UNSIGNED_INT, (void*)0);
+    headless().addWork(meshInds.size() / 3.0);
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glUseProgram(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 }
 
 
@@ -182,13 +441,16 @@ void indexToCtrlCoord(int idx, int& cx, int& cy) {
 
 // keyboard and interaction
 void adjustSelectedControlPoint(float dx, float dy, float dz) {
+    if (patchModel.patchCount > 0) return; // models are view-only
     int cx, cy;
     indexToCtrlCoord(selectedIndex, cx, cy);
     ctrl[cx][cy].x += dx;
     ctrl[cx][cy].y += dy;
     ctrl[cx][cy].z += dz;
     computePatchCenter();
-    buildMesh();
+    if (useAdaptive) adaptiveDirty = true;
+    else if (meshRes == res) updateMeshForControlPoint(cx, cy, Vec3(dx, dy, dz));
+    else buildMesh();
 }
 
 void glutDisplay() {
@@ -197,13 +459,14 @@ void glutDisplay() {
     glEnable(GL_DEPTH_TEST);
 
     // Setup projection and camera
+    int w = headless().active() ? headless().width() : glutGet(GLUT_WINDOW_WIDTH);
+    int h = headless().active() ? headless().height() : glutGet(GLUT_WINDOW_HEIGHT);
+
     glMatrixMode(GL_PROJECTION);
-    glLoadIdentity();
-    float aspect = (float)glutGet(GLUT_WINDOW_WIDTH) / (float)glutGet(GLUT_WINDOW_HEIGHT);
-    gluPerspective(45.0, aspect, 0.1, 100.0);
+    float aspect = (float)w / (float)h;
+    glLoadMatrixf(perspective(45.0f, aspect, 0.1f, 100.0f).m);
 
     glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
 
     // compute camera position in Cartesian coords
     float az = camAzimuth * M_PI / 180.0f;
@@ -213,9 +476,9 @@ void glutDisplay() {
     camPos.y = patchCenter.y + camDist * sinf(el);
     camPos.z = patchCenter.z + camDist * cosf(el) * sinf(az);
 
-    gluLookAt(camPos.x, camPos.y, camPos.z,
-        patchCenter.x, patchCenter.y, patchCenter.z,
-        0.0, 1.0, 0.0);
+    glLoadMatrixf(lookAt(camPos, patchCenter, Vec3(0, 1, 0)).m);
+
+    if (useAdaptive) buildAdaptiveMesh(camPos, h);
 
     // set light at camera position 
     Vec3 lightPos = camPos;
@@ -234,87 +497,100 @@ void glutDisplay() {
     glPopMatrix();
 
     // draw patch triangles with per-triangle color
-    glShadeModel(GL_FLAT);
-    glBegin(GL_TRIANGLES);
-    for (size_t i = 0;i < triangles.size();i++) {
-        Tri& t = triangles[i];
-        // triangle center
-        Vec3 center = (t.v0 + t.v1 + t.v2) * (1.0f / 3.0f);
-        Vec3 L = normalize(lightPos - center);
-        float ndotl = dotp(t.normal, L);
-        if (ndotl < 0) ndotl = 0;
-        Vec3 col = Vec3(kd.x * lightColor.x * ndotl,
-            kd.y * lightColor.y * ndotl,
-            kd.z * lightColor.z * ndotl);
-        
-        Vec3 ambient = Vec3(0.08f, 0.08f, 0.08f);
-        col = col + ambient;
-        // clamp
-        col.x = fminf(1.0f, col.x); col.y = fminf(1.0f, col.y); col.z = fminf(1.0f, col.z);
-        glColor3f(col.x, col.y, col.z);
-        // supply normal for correctness 
-        glNormal3f(t.normal.x, t.normal.y, t.normal.z);
-        glVertex3f(t.v0.x, t.v0.y, t.v0.z);
-        glVertex3f(t.v1.x, t.v1.y, t.v1.z);
-        glVertex3f(t.v2.x, t.v2.y, t.v2.z);
+    if (retainedOk && useRetained) drawMeshRetained(lightPos);
+    else {
+        if (trianglesStale) {
+            JobPool& pool = jobPool();
+            pool.parallelFor(0, meshRes, pool.grainFor(meshRes), [&](int v0, int v1) { buildTriRows(v0, v1); });
+            trianglesStale = false;
+        }
+        glShadeModel(GL_FLAT);
+        glBegin(GL_TRIANGLES);
+        for (size_t i = 0;i < triangles.size();i++) {
+            Tri& t = triangles[i];
+            // triangle center
+            Vec3 center = (t.v0 + t.v1 + t.v2) * (1.0f / 3.0f);
+            Vec3 L = unitOrZ(lightPos - center);
+            float ndotl = dotp(t.normal, L);
+            if (ndotl < 0) ndotl = 0;
+            Vec3 col = Vec3(kd.x * lightColor.x * ndotl,
+                kd.y * lightColor.y * ndotl,
+                kd.z * lightColor.z * ndotl);
+            
+            Vec3 ambient = Vec3(0.08f, 0.08f, 0.08f);
+            col = col + ambient;
+            // clamp
+            col.x = fminf(1.0f, col.x); col.y = fminf(1.0f, col.y); col.z = fminf(1.0f, col.z);
+            glColor3f(col.x, col.y, col.z);
+            // supply normal for correctness 
+            glNormal3f(t.normal.x, t.normal.y, t.normal.z);
+            glVertex3f(t.v0.x, t.v0.y, t.v0.z);
+            glVertex3f(t.v1.x, t.v1.y, t.v1.z);
+            glVertex3f(t.v2.x, t.v2.y, t.v2.z);
+        }
+        glEnd();
+        headless().addWork((double)triangles.size());
     }
-    glEnd();
 
     // draw control points (GL_POINTS)
-    glPointSize(8.0f);
-    glBegin(GL_POINTS);
-    for (int y = 0;y < 4;y++) {
-        for (int x = 0;x < 4;x++) {
-            int idx = y * 4 + x;
-            if (idx == selectedIndex) {
-                glPointSize(12.0f);
-                glColor3f(1.0f, 1.0f, 0.0f); // highlight
-            }
-            else {
-                glPointSize(6.0f);
-                glColor3f(0.9f, 0.9f, 0.9f);
+    if (patchModel.patchCount == 0) {
+        glPointSize(8.0f);
+        glBegin(GL_POINTS);
+        for (int y = 0;y < 4;y++) {
+            for (int x = 0;x < 4;x++) {
+                int idx = y * 4 + x;
+                if (idx == selectedIndex) {
+                    glPointSize(12.0f);
+                    glColor3f(1.0f, 1.0f, 0.0f); // highlight
+                }
+                else {
+                    glPointSize(6.0f);
+                    glColor3f(0.9f, 0.9f, 0.9f);
+                }
+                // draw actual point
+                glVertex3f(ctrl[x][y].x, ctrl[x][y].y, ctrl[x][y].z);
             }
-            // draw actual point
-            glVertex3f(ctrl[x][y].x, ctrl[x][y].y, ctrl[x][y].z);
         }
-    }
-    glEnd();
-
-    // draw lines connecting control points in grid
-    glLineWidth(1.5f);
-    glColor3f(0.6f, 0.6f, 0.6f);
-    // horizontal lines x
-    for (int y = 0;y < 4;y++) {
-        glBegin(GL_LINE_STRIP);
-        for (int x = 0;x < 4;x++) glVertex3f(ctrl[x][y].x, ctrl[x][y].y, ctrl[x][y].z);
-        glEnd();
-    }
-    // vertical lines y
-    for (int x = 0;x < 4;x++) {
-        glBegin(GL_LINE_STRIP);
-        for (int y = 0;y < 4;y++) glVertex3f(ctrl[x][y].x, ctrl[x][y].y, ctrl[x][y].z);
         glEnd();
+
+        // draw lines connecting control points in grid
+        glLineWidth(1.5f);
+        glColor3f(0.6f, 0.6f, 0.6f);
+        // horizontal lines x
+        for (int y = 0;y < 4;y++) {
+            glBegin(GL_LINE_STRIP);
+            for (int x = 0;x < 4;x++) glVertex3f(ctrl[x][y].x, ctrl[x][y].y, ctrl[x][y].z);
+            glEnd();
+        }
+        // vertical lines y
+        for (int x = 0;x < 4;x++) {
+            glBegin(GL_LINE_STRIP);
+            for (int y = 0;y < 4;y++) glVertex3f(ctrl[x][y].x, ctrl[x][y].y, ctrl[x][y].z);
+            glEnd();
+        }
     }
 
     // HUD text
     glMatrixMode(GL_PROJECTION);
     glPushMatrix();
     glLoadIdentity();
-    glOrtho(0, glutGet(GLUT_WINDOW_WIDTH), 0, glutGet(GLUT_WINDOW_HEIGHT), -1, 1);
+    glOrtho(0, w, 0, h, -1, 1);
     glMatrixMode(GL_MODELVIEW);
     glPushMatrix();
     glLoadIdentity();
     glColor3f(1, 1, 1);
     char buf[256];
     sprintf_s(buf, "res = %d  (use +/-)   selected = %d (0-9,a-f)  move: j/l i/k u/o  reset: r  quit: q/esc", res, selectedIndex);
-    glRasterPos2i(10, glutGet(GLUT_WINDOW_HEIGHT) - 20);
-    for (char* c = buf; *c; c++) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+    glRasterPos2i(10, h - 20);
+    // GLUT's bitmap font is not there without a GLUT window
+    if (!headless().active())
+        for (char* c = buf; *c; c++) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
     glPopMatrix();
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
     glMatrixMode(GL_MODELVIEW);
 
-    glutSwapBuffers();
+    if (!headless().active()) glutSwapBuffers();
 }
 
 void glutIdle() {
@@ -337,7 +613,7 @@ void keyboard(unsigned char key, int x, int y) {
     switch (key) {
     case 27: case 'q': exit(0); break;
     case 'r': // reset view
-        camDist = 6.0f; camAzimuth = 45.0f; camElevation = 20.0f;
+        camDist = defaultCamDist; camAzimuth = 45.0f; camElevation = 20.0f;
         computePatchCenter(); buildMesh();
         break;
     case '+': res = min(100, res + 1); buildMesh(); break;
@@ -360,6 +636,18 @@ void keyboard(unsigned char key, int x, int y) {
         // camera zoom in/out
     case 'w': camDist = max(1.2f, camDist - 0.4f); break;
     case 's': camDist = min(50.0f, camDist + 0.4f); break;
+        // switch between the retained VBO renderer and immediate mode
+    case 'v':
+        if (!retainedOk) { printf("Retained renderer needs OpenGL 2.0 shaders\n"); break; }
+        useRetained = !useRetained;
+        printf("Renderer: %s\n", useRetained ? "retained VBO + shader" : "immediate mode");
+        break;
+    case 't':
+        if (patchModel.patchCount > 0) { printf("Adaptive tessellation works on the single patch only\n"); break; }
+        useAdaptive = !useAdaptive;
+        if (!useAdaptive) buildMesh();
+        printf("Adaptive tessellation %s\n", useAdaptive ? "ON" : "OFF");
+        break;
         // helpful debug: print control point coords
     case 'p': {
         printf("Control points:\n");
@@ -375,35 +663,100 @@ void keyboard(unsigned char key, int x, int y) {
     glutPostRedisplay();
 }
 
+// Scripted input for -headless: the camera orbits for the whole run. The
+// first half sweeps res through 4..100 on the retained renderer, the third
+// quarter draws the same in immediate mode and the last one tessellates
+// adaptively (single patch only). Outside the immediate-mode quarter an inner
+// control point bobs up and down, so incremental VBO updates are timed too.
+void headlessScript(int frame, int frames) {
+    int phase = 4 * frame / frames;
+    camAzimuth = 45.0f + 360.0f * frame / frames;
+    camElevation = 20.0f + 15.0f * sinf(frame * 0.05f);
+    useRetained = phase != 2;
+
+    bool adaptive = phase == 3 && patchModel.patchCount == 0;
+    if (adaptive != useAdaptive) {
+        useAdaptive = adaptive;
+        if (!useAdaptive) buildMesh();
+    }
+    int r = 4 + 4 * (frame / 8 % 25);
+    if (!useAdaptive && r != res) {
+        res = r;
+        buildMesh();
+    }
+    if (phase != 2) {
+        selectedIndex = 5;
+        adjustSelectedControlPoint(0, 0.3f * (sinf((frame + 1) * 0.2f) - sinf(frame * 0.2f)), 0);
+    }
+}
+
 int main(int argc, char** argv) {
-    
+    bool offscreen = headless().parse(argc, argv);
+    if (!offscreen) glutInit(&argc, argv);
+
+    // optional multi-patch model: task1 teapot.bpt
+    const char* modelFile = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-headless") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) i++;
+        else if (argv[i][0] != '-') { modelFile = argv[i]; break; }
+    }
+    if (modelFile && !loadBpt(modelFile, patchModel))
+        cerr << "Could not load model " << modelFile << ", using the single patch\n";
+
     bool loaded = loadControlPointsFromFile("patchPoints.txt");
     if (!loaded) setDefaultControlPoints();
     computePatchCenter();
+    camDist = defaultCamDist;
     buildMesh();
 
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
-    glutInitWindowSize(900, 700);
-    glutCreateWindow(" Bezier Patch Task1");
+    if (offscreen) {
+        if (!headless().createContext()) return 1;
+    }
+    else {
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB | GLUT_DEPTH);
+        glutInitWindowSize(900, 700);
+        glutCreateWindow(" Bezier Patch Task1");
+    }
+
+    retainedOk = initRetained();
+    if (!retainedOk) cout << "Shaders unavailable, drawing in immediate mode\n";
 
     glEnable(GL_POINT_SMOOTH);
     glPointSize(8.0f);
     glEnable(GL_NORMALIZE);
 
+    if (offscreen) {
+        if (!headless().createTarget(900, 700)) return 1;
+        while (headless().nextFrame()) {
+            headlessScript(headless().frame(), headless().frameCount());
+            glutDisplay();
+        }
+        headless().report("task1", "triangles");
+        headless().destroy();
+        return 0;
+    }
+
     glutDisplayFunc(glutDisplay);
     glutIdleFunc(glutIdle);
     glutKeyboardFunc(keyboard);
     glutSpecialFunc(specialKeys);
 
+    cout << "Patch evaluation: " << simdLevelName(bezierSimdLevel())
+        << ", " << jobPool().threadCount() << " thread(s)\n";
+    if (patchModel.patchCount > 0)
+        cout << "Model: " << patchModel.patchCount << " patches, " << triangles.size() << " triangles\n";
     cout << "Controls:\n";
     cout << "  Select control point: keys 0-9 and a-f (a->10 ... f->15). Also '[' and ']' cycle.\n";
     cout << "  Move selected point: j/l (-x/+x), i/k (+y/-y), u/o (+z/-z)\n";
     cout << "  Increase/decrease sampling: + / -\n";
+    cout << "  Toggle screen-space adaptive tessellation: t\n";
+    cout << "  Toggle retained VBO / immediate-mode renderer: v\n";
     cout << "  Camera rotate: arrow keys  Zoom: w (in) s (out)\n";
     cout << "  Reset view: r   Quit: q or Esc\n";
     cout << "  Print control points: p\n";
     cout << "  Default control points will be used unless patchPoints.txt is present.\n";
+    cout << "  Pass a .bpt file (e.g. the Utah teapot) to view a multi-patch model instead.\n";
+    cout << "  Run with -headless [frames] to benchmark a scripted run offscreen without a window.\n";
 
     glutMainLoop();
     return 0;
@@ -1,5 +1,5 @@
 // bezier_patch_modern.cpp
-// Compile with: g++ bezier_patch_modern.cpp -lGLEW -lGL -lGLU -lglut -std=c++17 -O2
+// Compile with: g++ bezier_patch_modern.cpp -lGLEW -lGL -lGLU -lglut -lEGL -std=c++17 -O2 -pthread
 
 #include <GL/glew.h>
 #include <GL/freeglut.h>
@@ -9,31 +9,32 @@
 #include <fstream>
 #include <algorithm>
 #include <cstring>
+#include <map>
+#include <cstdint>
+
+#include "bezier_simd.h"
+#include "job_pool.h"
+#include "bezier_adaptive.h"
+#include "bezier_model.h"
+#include "mesh_cache.h"
+#include "stream_buffer.h"
+#include "gl_program.h"
+#include "frame_profiler.h"
+#include "headless.h"
+#include "vec_math.h"
+#include "mesh_clusters.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-struct Vec3 {
-    float x, y, z;
-    Vec3() : x(0), y(0), z(0) {}
-    Vec3(float X, float Y, float Z) : x(X), y(Y), z(Z) {}
-    Vec3 operator+(const Vec3& o) const { return Vec3(x + o.x, y + o.y, z + o.z); }
-    Vec3 operator-(const Vec3& o) const { return Vec3(x - o.x, y - o.y, z - o.z); }
-    Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
-};
-static Vec3 crossp(const Vec3& a, const Vec3& b) {
-    return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
-}
-static float dotp(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
-static Vec3 normalize(const Vec3& v) {
-    float L = sqrtf(dotp(v, v));
-    return (L > 1e-6f) ? Vec3(v.x / L, v.y / L, v.z / L) : v;
-}
-
 // Control points
 Vec3 ctrl[4][4];
 
+// Multi-patch model from a .bpt file on the command line; drawn instead of
+// ctrl when loaded
+BezierModel patchModel;
+
 bool loadControlPointsFromFile(const char* fname) {
     std::ifstream in(fname);
     if (!in.is_open()) return false;
@@ -105,87 +106,267 @@ Vec3 evalPv(float u, float v) {
 }
 
 struct Vertex { float px, py, pz, nx, ny, nz, u, v; };
+
+// LOD chain vertex: its own position and normal plus where it sits on the
+// next coarser level, for the vertex shader to morph towards
+struct MorphVertex { Vertex v; float mpx, mpy, mpz, mnx, mny, mnz; };
+
+// Compact upload format (12 bytes): position as 16-bit unorm within the
+// mesh's bounding box, normal as GL_INT_2_10_10_10_REV. The uniform grid
+// derives its UVs from gl_VertexID and RES; other meshes append a 16-bit UV
+// pair (PackedUVVertex, 16 bytes).
+struct PackedVertex { uint16_t px, py, pz, pad; uint32_t n; };
+struct PackedUVVertex { PackedVertex v; uint16_t u, t; };
+
+inline uint32_t packSnorm1010102(float x, float y, float z) {
+    auto q = [](float f) { return (uint32_t)(int)lroundf(std::max(-1.0f, std::min(1.0f, f)) * 511.0f) & 0x3ffu; };
+    return q(x) | q(y) << 10 | q(z) << 20;
+}
+inline uint16_t packUnorm16(float f) {
+    return (uint16_t)lroundf(std::max(0.0f, std::min(1.0f, f)) * 65535.0f);
+}
+
 std::vector<Vertex> verts;
 std::vector<unsigned int> inds;
 int RES = 32;
 
-void buildMesh() {
-    verts.clear(); inds.clear();
-    for (int j = 0; j < RES; j++) {
-        float v = j / float(RES - 1);
-        for (int i = 0; i < RES; i++) {
-            float u = i / float(RES - 1);
-            Vec3 P = evalP(u, v);
-            Vec3 Pu = evalPu(u, v);
-            Vec3 Pv = evalPv(u, v);
+// Basis values at one parameter value, computed once per grid row/column
+struct Basis { float B[4], dB[4]; };
+
+// Fused evaluator: fills P, dP/du, dP/dv (as position + normal) and UV for a
+// res x res grid. The tensor product is done separably: for each row v, ctrl is
+// collapsed into four curves along v (C = sum ctrl*Bv, D = sum ctrl*dBv), which
+// are then evaluated along u with the cached Bu/dBu values. Only rows
+// [j0, j1) are written, so row blocks can be filled in parallel.
+void evalPatchGrid(int res, int j0, int j1, Vertex* out) {
+    std::vector<Basis> bas(res);
+    for (int i = 0; i < res; i++) {
+        float t = i / float(res - 1);
+        bernstein3(t, bas[i].B);
+        bernstein3_deriv(t, bas[i].dB);
+    }
+    for (int j = j0; j < j1; j++) {
+        const Basis& bv = bas[j];
+        Vec3 C[4], D[4];
+        for (int i = 0; i < 4; i++) {
+            C[i] = ctrl[i][0] * bv.B[0] + ctrl[i][1] * bv.B[1] + ctrl[i][2] * bv.B[2] + ctrl[i][3] * bv.B[3];
+            D[i] = ctrl[i][0] * bv.dB[0] + ctrl[i][1] * bv.dB[1] + ctrl[i][2] * bv.dB[2] + ctrl[i][3] * bv.dB[3];
+        }
+        float v = j / float(res - 1);
+        Vertex* row = out + j * res;
+        for (int i = 0; i < res; i++) {
+            const Basis& bu = bas[i];
+            Vec3 P  = C[0] * bu.B[0]  + C[1] * bu.B[1]  + C[2] * bu.B[2]  + C[3] * bu.B[3];
+            Vec3 Pu = C[0] * bu.dB[0] + C[1] * bu.dB[1] + C[2] * bu.dB[2] + C[3] * bu.dB[3];
+            Vec3 Pv = D[0] * bu.B[0]  + D[1] * bu.B[1]  + D[2] * bu.B[2]  + D[3] * bu.B[3];
             Vec3 N = normalize(crossp(Pu, Pv));
-            Vertex vt = { P.x, P.y, P.z, N.x, N.y, N.z, u, v };
-            verts.push_back(vt);
+            row[i] = { P.x, P.y, P.z, N.x, N.y, N.z, i / float(res - 1), v };
         }
     }
-    for (int j = 0; j < RES - 1; j++) {
-        for (int i = 0; i < RES - 1; i++) {
-            unsigned int i00 = j * RES + i;
-            unsigned int i10 = i00 + 1;
-            unsigned int i01 = i00 + RES;
-            unsigned int i11 = i01 + 1;
-            inds.insert(inds.end(), { i00, i10, i11, i00, i11, i01 });
+}
+
+// ctrl in the structure-of-arrays layout of bezier_simd.h
+PatchSoA ctrlSoA() {
+    PatchSoA p;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++) {
+            p.x[i * 4 + j] = ctrl[i][j].x;
+            p.y[i * 4 + j] = ctrl[i][j].y;
+            p.z[i * 4 + j] = ctrl[i][j].z;
         }
+    return p;
+}
+
+// Same grid through the SoA row kernel (bezier_simd.h): the net collapses
+// against v once per row, the lanes evaluate only the u cubics
+void evalPatchGridBatch(int res, int j0, int j1, Vertex* out) {
+    PatchSoA p = ctrlSoA();
+    std::vector<float> buf(size_t(res) * 7);
+    float* us = buf.data();
+    PatchSamples s = { us + res, us + 2 * res, us + 3 * res, us + 4 * res, us + 5 * res, us + 6 * res };
+    for (int i = 0; i < res; i++) us[i] = i / float(res - 1);
+    for (int j = j0; j < j1; j++) {
+        float v = j / float(res - 1);
+        evalPatchRow(p, us, v, res, s);
+        Vertex* row = out + j * res;
+        for (int i = 0; i < res; i++)
+            row[i] = { s.px[i], s.py[i], s.pz[i], s.nx[i], s.ny[i], s.nz[i], us[i], v };
     }
 }
 
+// Every patch of patchModel into the shared buffers, borders welded
+void buildModelMesh() {
+    ModelMesh m;
+    tessellateModel(patchModel, RES, m);
+    size_t nv = m.vertexCount();
+    verts.resize(nv);
+    for (size_t k = 0; k < nv; k++)
+        verts[k] = { m.pos[3 * k], m.pos[3 * k + 1], m.pos[3 * k + 2],
+                     m.nrm[3 * k], m.nrm[3 * k + 1], m.nrm[3 * k + 2], m.uv[2 * k], m.uv[2 * k + 1] };
+    inds.swap(m.inds);
+}
+
+// Rows of vertices are spread over the job pool; each row writes its own
+// preallocated slice, so the result does not depend on the number of
+// threads. The grid's index list only depends on RES and comes from
+// gridIndices().
+void buildMesh() {
+    ProfileScope scope("buildMesh");
+    if (patchModel.patchCount > 0) { buildModelMesh(); return; }
+    JobPool& pool = jobPool();
+    verts.resize(size_t(RES) * RES);
+    bool simd = bezierSimdLevel() != SIMD_SCALAR;
+    pool.parallelFor(0, RES, pool.grainFor(RES), [&](int j0, int j1) {
+        if (simd) evalPatchGridBatch(RES, j0, j1, verts.data());
+        else evalPatchGrid(RES, j0, j1, verts.data());
+    });
+    inds.clear();
+}
+
+// Indices of a res x res grid, either as a triangle list or as one strip per
+// row of quads separated by the primitive restart index (~0 of T). Both keep
+// the i00-i11 diagonal and counter-clockwise winding in (u,v).
+template <class T>
+void gridIndexData(int res, bool strips, std::vector<T>& out) {
+    out.clear();
+    if (strips) {
+        out.reserve(size_t(res - 1) * (2 * res + 1));
+        for (int j = 0; j < res - 1; j++) {
+            if (j > 0) out.push_back(T(~T(0)));
+            for (int i = 0; i < res; i++) {
+                out.push_back(T((j + 1) * res + i));
+                out.push_back(T(j * res + i));
+            }
+        }
+        return;
+    }
+    out.reserve(size_t(res - 1) * (res - 1) * 6);
+    for (int j = 0; j < res - 1; j++)
+        for (int i = 0; i < res - 1; i++) {
+            T i00 = T(j * res + i);
+            T i10 = T(i00 + 1);
+            T i01 = T(i00 + res);
+            T i11 = T(i01 + 1);
+            out.insert(out.end(), { i00, i10, i11, i00, i11, i01 });
+        }
+}
+
 // GL objects
-GLuint vao = 0, vbo = 0, ebo = 0, tex = 0, prog = 0;
+GLuint vao = 0, ebo = 0, tex = 0;
+GLProgram prog;
+GLint locPosScale = -1, locPosBias = -1, locGridRes = -1, locMorph = -1; // prog's plain uniforms
+
+// CPU mesh vertices are streamed through a ring (stream_buffer.h): a new RES
+// or eye position writes the next free range instead of reallocating a VBO
+// the GPU may still be reading
+StreamBuffer* vertexStream = nullptr;
+size_t vertexOffset = 0; // where the current vertices start in vertexStream
+
+// What the element buffer bound to vao holds
+GLenum drawMode = GL_TRIANGLES, drawIndexType = GL_UNSIGNED_INT;
+GLsizei indexCount = 0;
+
+// Grid index buffers, built once per (RES, strips) and reused whenever only
+// the vertices change. 16-bit whenever every vertex (and the restart index)
+// fits, which covers every RES the keys allow.
+struct GridIndices { GLuint ebo; GLsizei count; GLenum type; };
+std::map<std::pair<int, bool>, GridIndices> gridIndexCache;
+bool useStrips = true;
+
+// Vertex format in vertexStream (see PackedVertex) and what the shader needs to undo it
+bool compactVerts = false;
+float posScale[3] = { 1, 1, 1 }, posBias[3] = { 0, 0, 0 };
+int uvGridRes = 0;      // > 0: UVs from gl_VertexID on a uvGridRes^2 grid
+size_t vertexBytes = 0; // size of the vertex data at vertexOffset
 bool useTex = true;
 
+// GPU tessellation mode objects
+GLuint patchVao = 0, patchVbo = 0;
+GLProgram tessProg;
+GLint locTessLevel = -1, locTiles = -1;
+bool tessSupported = false, useGpuTess = false;
+GLint maxTessLevel = 64;
+int meshRes = 0; // RES the CPU mesh was last built for
+
+// Screen-space adaptive mode (bezier_adaptive.h); rebuilt when the view moves
+bool useAdaptive = false;
+float adaptivePixelTol = 1.0f;
+float adaptiveKey[4] = { 0, 0, 0, 0 }; // eye + viewport height it was built for
+
+// Distance-based LOD for the single patch: grids with LOD_BASE_SEGS << L
+// segments per side, built once into static buffers. The level comes from
+// the patch's projected size and the morph factor slides each level into the
+// next coarser one before it is swapped in, so nothing pops.
+const int LOD_LEVELS = 5, LOD_BASE_SEGS = 8;
+bool useLod = true;
+float lodPixelsPerSegment = 6.0f;
+GLuint lodVao[LOD_LEVELS] = {}, lodVbo[LOD_LEVELS] = {};
+bool lodBuilt = false;
+int lodLevel = 0;     // level drawn this frame
+float lodMorph = 0.0f; // 0: the level itself, 1: the next coarser one
+
+// Cluster culling (mesh_clusters.h): each CPU mesh also gets a triangle list
+// in cluster order. With culling on, only the clusters inside the frustum
+// and not wholly back-facing are drawn, in one glMultiDrawElements call, so
+// the vertex shader never runs for hidden parts. Lists reuse fewer vertices
+// than strips, so a strip mesh is still drawn whole when culling would keep
+// more than CLUSTER_MAX_KEPT of it.
+const unsigned int CLUSTER_TRIANGLES = 128;
+const double CLUSTER_MAX_KEPT = 0.75;
+struct ClusteredIndices {
+    GLuint ebo = 0;
+    std::vector<MeshCluster> clusters; // empty: not built for the current mesh
+};
+ClusteredIndices meshClusters; // for the mesh in vao
+ClusteredIndices lodClusters[LOD_LEVELS];
+bool useCulling = true;
+std::vector<int> clusterCounts;
+std::vector<const void*> clusterOffsets;
+double clusterIndicesKept = 0, clusterIndicesTotal = 0; // summed over frames, for -headless
+
 // Camera (single set of vars)
 float camYawDeg = 45.0f, camPitchDeg = 20.0f, camDistVal = 6.0f;
 
-// Shader helpers
-GLuint compile(GLenum type, const char* src) {
-    GLuint sh = glCreateShader(type);
-    glShaderSource(sh, 1, &src, nullptr);
-    glCompileShader(sh);
-    GLint ok;
-    glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
-    if (!ok) {
-        char log[1024]; glGetShaderInfoLog(sh, 1024, nullptr, log);
-        std::cerr << "Shader compile error:\n" << log << std::endl;
-        std::cerr << "Shader source:\n" << src << std::endl;
-        exit(1);
-    }
-    return sh;
-}
-GLuint link(GLuint vs, GLuint fs) {
-    GLuint p = glCreateProgram();
-    glAttachShader(p, vs); glAttachShader(p, fs);
-    glLinkProgram(p);
-    GLint ok;
-    glGetProgramiv(p, GL_LINK_STATUS, &ok);
-    if (!ok) {
-        char log[1024]; glGetProgramInfoLog(p, 1024, nullptr, log);
-        std::cerr << "Program link error:\n" << log << std::endl;
-        exit(1);
-    }
-    return p;
-}
+// Per-frame data both programs read from uniform blocks (std140 layout)
+struct CameraBlock {
+    float model[16], view[16], proj[16];
+    float normalMat[12]; // mat3: three columns padded to vec4
+};
+struct MaterialBlock {
+    float lightPosView[3], pad0;
+    float lightColor[3], pad1;
+    float specular[3], pad2;
+    float ambient[3], shininess; // a scalar may fill the slot after a vec3
+    int useTexture, pad3[3];
+};
+const GLuint CAMERA_BINDING = 0, MATERIAL_BINDING = 1;
+UniformBlock<CameraBlock> cameraBlock;
+UniformBlock<MaterialBlock> materialBlock;
 
 const char* vsSrc = R"(
 #version 330 core
 layout(location=0) in vec3 inPos;
 layout(location=1) in vec3 inNormal;
 layout(location=2) in vec2 inUV;
-uniform mat4 uModel, uView, uProj;
-uniform mat3 uNormalMat;
+layout(location=3) in vec3 inMorphPos;    // LOD chain only: position and
+layout(location=4) in vec3 inMorphNormal; // normal on the coarser level
+layout(std140) uniform Camera {
+    mat4 uModel, uView, uProj;
+    mat3 uNormalMat;
+};
+uniform vec3 uPosScale, uPosBias; // dequantizes compact positions
+uniform int uGridRes;             // > 0: derive UVs from the vertex index
+uniform float uMorph;             // geomorph towards the coarser level
 out vec3 vPosView;
 out vec3 vNormalView;
 out vec2 vUV;
 void main(){
-    vec4 w = uModel * vec4(inPos, 1.0);
+    vec3 p = mix(inPos * uPosScale + uPosBias, inMorphPos, uMorph);
+    vec4 w = uModel * vec4(p, 1.0);
     vec4 pv = uView * w;
     vPosView = pv.xyz;
-    vNormalView = normalize(uNormalMat * inNormal);
-    vUV = inUV;
+    vNormalView = normalize(uNormalMat * mix(inNormal, inMorphNormal, uMorph));
+    vUV = uGridRes > 0 ? vec2(gl_VertexID % uGridRes, gl_VertexID / uGridRes) / float(uGridRes - 1) : inUV;
     gl_Position = uProj * pv;
 })";
 
@@ -194,10 +375,12 @@ const char* fsSrc = R"(
 in vec3 vPosView, vNormalView;
 in vec2 vUV;
 out vec4 frag;
-uniform vec3 uLightPosView, uLightColor, uSpecular, uAmbient;
-uniform float uShininess;
+layout(std140) uniform Material {
+    vec3 uLightPosView, uLightColor, uSpecular, uAmbient;
+    float uShininess;
+    bool uUseTexture;
+};
 uniform sampler2D uTex;
-uniform bool uUseTexture;
 void main(){
     vec3 N = normalize(vNormalView);
     vec3 L = normalize(uLightPosView - vPosView);
@@ -212,98 +395,101 @@ void main(){
     frag = vec4(amb + diff + spec, 1.0);
 })";
 
-// Simple mat4 (column-major), mat3 utilities
-struct Mat4 { float m[16]; Mat4(){ std::fill(m, m+16, 0.0f); } };
-Mat4 mat_identity() { Mat4 I; I.m[0]=I.m[5]=I.m[10]=I.m[15]=1.0f; return I; }
-
-Mat4 mat_mul(const Mat4& A, const Mat4& B) {
-    Mat4 R;
-    for (int r=0;r<4;r++){
-        for (int c=0;c<4;c++){
-            float s=0;
-            for (int k=0;k<4;k++) s += A.m[k*4 + r] * B.m[c*4 + k]; // column-major index
-            R.m[c*4 + r] = s;
-        }
+// Hardware tessellation path (GL 4.0): the 16 control points are drawn as one
+// GL_PATCHES primitive per tile and the TES evaluates the patch. Tess levels
+// are capped by GL_MAX_TESS_GEN_LEVEL, so high RES splits the (u,v) domain
+// into uTiles x uTiles instanced tiles that share edge levels (no cracks).
+const char* tessVsSrc = R"(
+#version 400 core
+layout(location=0) in vec3 inPos;
+out vec3 vCtrl;
+flat out int vTile;
+void main(){
+    vCtrl = inPos;
+    vTile = gl_InstanceID;
+})";
+
+const char* tessTcsSrc = R"(
+#version 400 core
+layout(vertices = 16) out;
+in vec3 vCtrl[];
+flat in int vTile[];
+out vec3 tcCtrl[];
+patch out vec2 tcTile;
+uniform float uTessLevel;
+uniform int uTiles;
+void main(){
+    tcCtrl[gl_InvocationID] = vCtrl[gl_InvocationID];
+    if (gl_InvocationID == 0) {
+        tcTile = vec2(vTile[0] % uTiles, vTile[0] / uTiles);
+        gl_TessLevelOuter[0] = uTessLevel;
+        gl_TessLevelOuter[1] = uTessLevel;
+        gl_TessLevelOuter[2] = uTessLevel;
+        gl_TessLevelOuter[3] = uTessLevel;
+        gl_TessLevelInner[0] = uTessLevel;
+        gl_TessLevelInner[1] = uTessLevel;
     }
-    return R;
-}
+})";
 
-Mat4 perspective(float fovyDeg, float aspect, float znear, float zfar) {
-    float f = 1.0f / tanf(fovyDeg * (float)M_PI / 360.0f);
-    Mat4 M;
-    std::fill(M.m, M.m+16, 0.0f);
-    M.m[0] = f / aspect;
-    M.m[5] = f;
-    M.m[10] = (zfar + znear) / (znear - zfar);
-    M.m[11] = -1.0f;
-    M.m[14] = (2.0f * zfar * znear) / (znear - zfar);
-    return M;
+const char* tessTesSrc = R"(
+#version 400 core
+layout(quads, equal_spacing, ccw) in;
+in vec3 tcCtrl[];           // tcCtrl[i*4 + j] = ctrl[i][j]
+patch in vec2 tcTile;
+uniform int uTiles;
+layout(std140) uniform Camera {
+    mat4 uModel, uView, uProj;
+    mat3 uNormalMat;
+};
+out vec3 vPosView;
+out vec3 vNormalView;
+out vec2 vUV;
+void bernstein(float t, out vec4 B, out vec4 dB){
+    float om = 1.0 - t;
+    B = vec4(om * om * om, 3.0 * t * om * om, 3.0 * t * t * om, t * t * t);
+    dB = vec4(-3.0 * om * om, 3.0 * om * om - 6.0 * t * om, 6.0 * t * om - 3.0 * t * t, 3.0 * t * t);
 }
+void main(){
+    vec2 uv = (tcTile + gl_TessCoord.xy) / float(uTiles);
+    vec4 Bu, dBu, Bv, dBv;
+    bernstein(uv.x, Bu, dBu);
+    bernstein(uv.y, Bv, dBv);
+    vec3 P = vec3(0.0), Pu = vec3(0.0), Pv = vec3(0.0);
+    for (int i = 0; i < 4; i++) {
+        vec3 C = vec3(0.0), D = vec3(0.0);
+        for (int j = 0; j < 4; j++) {
+            C += tcCtrl[i * 4 + j] * Bv[j];
+            D += tcCtrl[i * 4 + j] * dBv[j];
+        }
+        P += C * Bu[i];
+        Pu += C * dBu[i];
+        Pv += D * Bu[i];
+    }
+    vec3 N = cross(Pu, Pv);
+    N = length(N) > 1e-6 ? normalize(N) : N;
+    vec4 pv = uView * (uModel * vec4(P, 1.0));
+    vPosView = pv.xyz;
+    vNormalView = normalize(uNormalMat * N);
+    vUV = uv;
+    gl_Position = uProj * pv;
+})";
 
-Mat4 lookAt(const Vec3& eye, const Vec3& center, const Vec3& up) {
-    Vec3 f = normalize(center - eye);
-    Vec3 s = normalize(crossp(f, up));
-    Vec3 u = crossp(s, f);
-
-    Mat4 M = mat_identity();
-    // column-major: m[col*4 + row]
-    M.m[0] = s.x; M.m[4] = s.y; M.m[8]  = s.z;
-    M.m[1] = u.x; M.m[5] = u.y; M.m[9]  = u.z;
-    M.m[2] = -f.x;M.m[6] = -f.y;M.m[10] = -f.z;
-    M.m[12] = -dotp(s, eye);
-    M.m[13] = -dotp(u, eye);
-    M.m[14] =  dotp(f, eye);
+// Centres a loaded model at the origin and scales it to the default patch size
+Mat4 modelFit() {
+    Mat4 M = Mat4::identity();
+    if (patchModel.patchCount == 0) return M;
+    float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+    for (size_t k = 0; k < patchModel.ctrl.size(); k++) {
+        lo[k % 3] = std::min(lo[k % 3], patchModel.ctrl[k]);
+        hi[k % 3] = std::max(hi[k % 3], patchModel.ctrl[k]);
+    }
+    float extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+    float s = extent > 0 ? 3.0f / extent : 1.0f;
+    M.m[0] = M.m[5] = M.m[10] = s;
+    for (int c = 0; c < 3; c++) M.m[12 + c] = -0.5f * (lo[c] + hi[c]) * s;
     return M;
 }
 
-// extract 3x3 (column-major) upper-left from mat4 into float[9]
-void mat4_to_mat3(const Mat4& M, float out3[9]) {
-    out3[0] = M.m[0]; out3[1] = M.m[1]; out3[2] = M.m[2];
-    out3[3] = M.m[4]; out3[4] = M.m[5]; out3[5] = M.m[6];
-    out3[6] = M.m[8]; out3[7] = M.m[9]; out3[8] = M.m[10];
-}
-
-// compute inverse of 3x3 matrix (column-major) into out (also column-major)
-// returns false if singular
-bool invert_mat3(const float m[9], float out[9]) {
-    // treat as column-major: index (c*3 + r), but determinant formula same for values
-    // convert to row-major for easier computation:
-    float a00 = m[0], a10 = m[1], a20 = m[2];
-    float a01 = m[3], a11 = m[4], a21 = m[5];
-    float a02 = m[6], a12 = m[7], a22 = m[8];
-
-    float det = a00*(a11*a22 - a21*a12) - a01*(a10*a22 - a20*a12) + a02*(a10*a21 - a20*a11);
-    if (fabs(det) < 1e-12f) return false;
-    float invDet = 1.0f / det;
-
-    // compute adjugate (row-major) then multiply by invDet
-    float r00 =  (a11*a22 - a21*a12) * invDet;
-    float r01 = -(a01*a22 - a21*a02) * invDet;
-    float r02 =  (a01*a12 - a11*a02) * invDet;
-
-    float r10 = -(a10*a22 - a20*a12) * invDet;
-    float r11 =  (a00*a22 - a20*a02) * invDet;
-    float r12 = -(a00*a12 - a10*a02) * invDet;
-
-    float r20 =  (a10*a21 - a20*a11) * invDet;
-    float r21 = -(a00*a21 - a20*a01) * invDet;
-    float r22 =  (a00*a11 - a10*a01) * invDet;
-
-    // write back as column-major
-    out[0] = r00; out[1] = r01; out[2] = r02;
-    out[3] = r10; out[4] = r11; out[5] = r12;
-    out[6] = r20; out[7] = r21; out[8] = r22;
-    return true;
-}
-
-// transpose 3x3 (column-major)
-void transpose3(const float in[9], float out[9]) {
-    // in[c*3 + r]
-    out[0] = in[0]; out[1] = in[3]; out[2] = in[6];
-    out[3] = in[1]; out[4] = in[4]; out[5] = in[7];
-    out[6] = in[2]; out[7] = in[5]; out[8] = in[8];
-}
-
 void makeTex(int N = 256) {
     std::vector<unsigned char> img(N * N * 3);
     for (int j = 0; j < N; j++)
@@ -325,31 +511,327 @@ void makeTex(int N = 256) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 }
 
-void upload() {
+const GridIndices& gridIndices(int res, bool strips) {
+    auto key = std::make_pair(res, strips);
+    auto it = gridIndexCache.find(key);
+    if (it != gridIndexCache.end()) return it->second;
+
+    GridIndices g;
+    glBindVertexArray(0); // keep the element binding of vao untouched
+    glGenBuffers(1, &g.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.ebo);
+    if ((long long)res * res < 0xFFFF) {
+        std::vector<unsigned short> data;
+        gridIndexData(res, strips, data);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.size() * sizeof(unsigned short), data.data(), GL_STATIC_DRAW);
+        g.count = (GLsizei)data.size();
+        g.type = GL_UNSIGNED_SHORT;
+    }
+    else {
+        std::vector<unsigned int> data;
+        gridIndexData(res, strips, data);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.size() * sizeof(unsigned int), data.data(), GL_STATIC_DRAW);
+        g.count = (GLsizei)data.size();
+        g.type = GL_UNSIGNED_INT;
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    return gridIndexCache.emplace(key, g).first->second;
+}
+
+// Points vao at the cached index buffer of a res x res grid
+void useGridIndices(int res, bool strips) {
+    const GridIndices& g = gridIndices(res, strips);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.ebo);
+    glBindVertexArray(0);
+    drawMode = strips ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+    drawIndexType = g.type;
+    indexCount = g.count;
+}
+
+// Packs vertices for the compact format and sets posScale/posBias to the
+// bounding box; 16-byte PackedUVVertex with UVs, 12-byte PackedVertex without
+void packVertices(const Vertex* v, size_t count, bool withUV, std::vector<unsigned char>& out) {
+    float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+    for (size_t k = 0; k < count; k++) {
+        const float p[3] = { v[k].px, v[k].py, v[k].pz };
+        for (int c = 0; c < 3; c++) { lo[c] = std::min(lo[c], p[c]); hi[c] = std::max(hi[c], p[c]); }
+    }
+    for (int c = 0; c < 3; c++) {
+        posBias[c] = count ? lo[c] : 0.0f;
+        posScale[c] = count && hi[c] > lo[c] ? hi[c] - lo[c] : 1.0f;
+    }
+    size_t stride = withUV ? sizeof(PackedUVVertex) : sizeof(PackedVertex);
+    out.resize(count * stride);
+    for (size_t k = 0; k < count; k++) {
+        PackedUVVertex pv;
+        pv.v.px = packUnorm16((v[k].px - posBias[0]) / posScale[0]);
+        pv.v.py = packUnorm16((v[k].py - posBias[1]) / posScale[1]);
+        pv.v.pz = packUnorm16((v[k].pz - posBias[2]) / posScale[2]);
+        pv.v.pad = 0;
+        pv.v.n = packSnorm1010102(v[k].nx, v[k].ny, v[k].nz);
+        pv.u = packUnorm16(v[k].u);
+        pv.t = packUnorm16(v[k].v);
+        memcpy(&out[k * stride], &pv, stride);
+    }
+}
+
+// Vertex data only; the element binding is left as it is. gridRes > 0 marks a
+// RES x RES grid whose UVs the compact format leaves to the shader.
+void uploadVertices(const Vertex* v, size_t count, int gridRes = 0) {
+    ProfileScope scope("uploadVertices", true);
     if (vao == 0) glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
-    if (vbo == 0) glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(Vertex), verts.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    if (!compactVerts) {
+        vertexOffset = vertexStream->write(v, count * sizeof(Vertex), sizeof(Vertex));
+        const char* base = (const char*)vertexOffset;
+        glBindBuffer(GL_ARRAY_BUFFER, vertexStream->id());
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), base);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), base + 3 * sizeof(float));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), base + 6 * sizeof(float));
+        posScale[0] = posScale[1] = posScale[2] = 1.0f;
+        posBias[0] = posBias[1] = posBias[2] = 0.0f;
+        uvGridRes = 0;
+        vertexBytes = count * sizeof(Vertex);
+    }
+    else {
+        bool withUV = gridRes <= 0;
+        GLsizei stride = withUV ? sizeof(PackedUVVertex) : sizeof(PackedVertex);
+        std::vector<unsigned char> packed;
+        packVertices(v, count, withUV, packed);
+        vertexOffset = vertexStream->write(packed.data(), packed.size(), stride);
+        const char* base = (const char*)vertexOffset;
+        glBindBuffer(GL_ARRAY_BUFFER, vertexStream->id());
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, base);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, base + offsetof(PackedVertex, n));
+        if (withUV) {
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, base + offsetof(PackedUVVertex, u));
+        }
+        else glDisableVertexAttribArray(2);
+        uvGridRes = withUV ? 0 : gridRes;
+        vertexBytes = packed.size();
+    }
+    glBindVertexArray(0);
+}
+
+// Vertices plus an index list of their own (models, adaptive meshes)
+void upload(const Vertex* v, size_t count, const unsigned int* idata, size_t icount) {
+    ProfileScope scope("upload", true);
+    uploadVertices(v, count);
+    glBindVertexArray(vao);
     if (ebo == 0) glGenBuffers(1, &ebo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, inds.size() * sizeof(unsigned int), inds.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, icount * sizeof(unsigned int), idata, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    drawMode = GL_TRIANGLES;
+    drawIndexType = GL_UNSIGNED_INT;
+    indexCount = (GLsizei)icount;
+}
+void upload() { upload(verts.data(), verts.size(), inds.data(), inds.size()); }
+
+// Sends the 16 control points per patch for the tessellation path (i-major,
+// like ctrl); a model is already stored that way
+void uploadPatch() {
+    std::vector<float> cp(16 * 3);
+    if (patchModel.patchCount > 0) cp = patchModel.ctrl;
+    else
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++) {
+                cp[(i * 4 + j) * 3 + 0] = ctrl[i][j].x;
+                cp[(i * 4 + j) * 3 + 1] = ctrl[i][j].y;
+                cp[(i * 4 + j) * 3 + 2] = ctrl[i][j].z;
+            }
+    if (patchVao == 0) glGenVertexArrays(1, &patchVao);
+    glBindVertexArray(patchVao);
+    if (patchVbo == 0) glGenBuffers(1, &patchVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, patchVbo);
+    glBufferData(GL_ARRAY_BUFFER, cp.size() * sizeof(float), cp.data(), GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(6 * sizeof(float)));
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glBindVertexArray(0);
 }
 
+// Clusters a triangle list over vertices `stride` floats apart into c
+void buildClusters(const float* pos, size_t stride, std::vector<unsigned int> idx, ClusteredIndices& c,
+                   const float* morphPos = nullptr) {
+    ProfileScope scope("buildClusters");
+    clusterTriangles(pos, stride, idx, CLUSTER_TRIANGLES, c.clusters, morphPos);
+    glBindVertexArray(0); // keep the element binding of vao untouched
+    if (c.ebo == 0) glGenBuffers(1, &c.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, c.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(unsigned int), idx.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// meshClusters for a mesh just uploaded to vao; gridRes > 0 marks the
+// uniform grid, whose indices are generated here
+void clusterMesh(const Vertex* v, const unsigned int* idata, size_t icount, int gridRes = 0) {
+    meshClusters.clusters.clear();
+    if (!useCulling) return;
+    std::vector<unsigned int> idx(idata, idata + icount);
+    if (gridRes > 0) gridIndexData(gridRes, false, idx);
+    buildClusters(&v->px, sizeof(Vertex) / sizeof(float), std::move(idx), meshClusters);
+}
+
+// Tessellated grids go through the on-disk cache (mesh_cache.h): a hit maps
+// the file and uploads it as is, a miss tessellates and writes the file. The
+// single patch only stores vertices; its indices come from gridIndices().
+const uint32_t VERTEX_LAYOUT = meshLayoutTag('P', 'N', 'T', '1'); // Vertex: pos, normal, uv
+bool useMeshCache = true;
+
+void loadOrBuildMesh() {
+    ProfileScope scope("loadOrBuildMesh");
+    std::vector<float> cp;
+    if (patchModel.patchCount > 0) cp = patchModel.ctrl;
+    else
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++) cp.insert(cp.end(), { ctrl[i][j].x, ctrl[i][j].y, ctrl[i][j].z });
+    uint64_t key = meshCacheKey(cp.data(), cp.size(), RES, VERTEX_LAYOUT);
+    std::string path = meshCachePath(key);
+
+    bool grid = patchModel.patchCount == 0;
+    MappedMesh file;
+    if (useMeshCache && file.open(path, key, VERTEX_LAYOUT, sizeof(Vertex))) {
+        const Vertex* v = (const Vertex*)file.vertices();
+        size_t n = file.vertexBytes() / sizeof(Vertex);
+        if (grid) uploadVertices(v, n, RES);
+        else upload(v, n, file.indices(), file.indexCount());
+        clusterMesh(v, file.indices(), grid ? 0 : file.indexCount(), grid ? RES : 0);
+        return;
+    }
+    buildMesh();
+    if (grid) uploadVertices(verts.data(), verts.size(), RES);
+    else upload();
+    clusterMesh(verts.data(), inds.data(), inds.size(), grid ? RES : 0);
+    if (useMeshCache && !writeMeshCache(path, key, VERTEX_LAYOUT, sizeof(Vertex), verts.data(), verts.size(),
+                                        inds.data(), inds.size()))
+        std::cerr << "Could not write mesh cache " << path << "\n";
+}
+
+// CPU mesh is only rebuilt when it is actually drawn
+void ensureCpuMesh() {
+    if (meshRes != RES) {
+        loadOrBuildMesh();
+        meshRes = RES;
+    }
+    if (patchModel.patchCount == 0) useGridIndices(RES, useStrips);
+}
+
+// Where each vertex of a res x res level sits on the next coarser level,
+// whose vertices are the even rows and columns. Odd vertices move to the
+// middle of the coarse edge they split, or of the i00-i11 diagonal that
+// gridIndexData() cuts every quad along, so at morph 1 the fine triangles
+// lie exactly on the coarse ones.
+void morphTargets(int res, const Vertex* v, bool coarser, MorphVertex* out) {
+    for (int j = 0; j < res; j++)
+        for (int i = 0; i < res; i++) {
+            int o = coarser ? 1 : 0;
+            const Vertex& a = v[(j - (j & o)) * res + i - (i & o)];
+            const Vertex& b = v[(j + (j & o)) * res + i + (i & o)];
+            out[j * res + i] = { v[j * res + i], 0.5f * (a.px + b.px), 0.5f * (a.py + b.py), 0.5f * (a.pz + b.pz),
+                                 0.5f * (a.nx + b.nx), 0.5f * (a.ny + b.ny), 0.5f * (a.nz + b.nz) };
+        }
+}
+
+// Tessellates every level of the chain into its own static buffer; level 0
+// has nothing coarser and morphs onto itself
+void buildLodChain() {
+    ProfileScope scope("buildLodChain");
+    JobPool& pool = jobPool();
+    bool simd = bezierSimdLevel() != SIMD_SCALAR;
+    std::vector<Vertex> grid;
+    std::vector<MorphVertex> mv;
+    glGenVertexArrays(LOD_LEVELS, lodVao);
+    glGenBuffers(LOD_LEVELS, lodVbo);
+    for (int L = 0; L < LOD_LEVELS; L++) {
+        int res = (LOD_BASE_SEGS << L) + 1;
+        grid.resize(size_t(res) * res);
+        pool.parallelFor(0, res, pool.grainFor(res), [&](int j0, int j1) {
+            if (simd) evalPatchGridBatch(res, j0, j1, grid.data());
+            else evalPatchGrid(res, j0, j1, grid.data());
+        });
+        mv.resize(grid.size());
+        morphTargets(res, grid.data(), L > 0, mv.data());
+        std::vector<unsigned int> idx;
+        gridIndexData(res, false, idx);
+        buildClusters(&mv[0].v.px, sizeof(MorphVertex) / sizeof(float), std::move(idx), lodClusters[L], &mv[0].mpx);
+
+        glBindVertexArray(lodVao[L]);
+        glBindBuffer(GL_ARRAY_BUFFER, lodVbo[L]);
+        glBufferData(GL_ARRAY_BUFFER, mv.size() * sizeof(MorphVertex), mv.data(), GL_STATIC_DRAW);
+        const GLsizei stride = sizeof(MorphVertex);
+        const size_t attribs[5][2] = { { 3, offsetof(MorphVertex, v.px) }, { 3, offsetof(MorphVertex, v.nx) },
+                                       { 2, offsetof(MorphVertex, v.u) }, { 3, offsetof(MorphVertex, mpx) },
+                                       { 3, offsetof(MorphVertex, mnx) } };
+        for (GLuint a = 0; a < 5; a++) {
+            glEnableVertexAttribArray(a);
+            glVertexAttribPointer(a, (GLint)attribs[a][0], GL_FLOAT, GL_FALSE, stride, (const void*)attribs[a][1]);
+        }
+    }
+    glBindVertexArray(0);
+    lodBuilt = true;
+}
+
+bool lodActive() { return useLod && !useAdaptive && patchModel.patchCount == 0; }
+
+// Continuous level from the projected diameter of the control net's bounding
+// sphere (it contains the patch): lambda = log2(segments wanted / base). The
+// finer of the two neighbouring levels is drawn, morphed by how far lambda
+// is below it.
+void selectLod(const Vec3& eye, int h) {
+    if (!lodBuilt) buildLodChain();
+    Vec3 lo(1e30f, 1e30f, 1e30f), hi(-1e30f, -1e30f, -1e30f);
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++) {
+            const Vec3& c = ctrl[i][j];
+            lo = Vec3(std::min(lo.x, c.x), std::min(lo.y, c.y), std::min(lo.z, c.z));
+            hi = Vec3(std::max(hi.x, c.x), std::max(hi.y, c.y), std::max(hi.z, c.z));
+        }
+    Vec3 center = (lo + hi) * 0.5f;
+    float radius = 0.5f * length(hi - lo);
+    float dist = std::max(length(eye - center) - radius, 0.1f);
+    float pixels = 2.0f * radius * h / (2.0f * tanf(45.0f * (float)M_PI / 360.0f) * dist);
+    float lambda = log2f(std::max(pixels / lodPixelsPerSegment, 1.0f) / LOD_BASE_SEGS);
+    lambda = std::max(0.0f, std::min((float)(LOD_LEVELS - 1), lambda));
+    lodLevel = (int)ceilf(lambda);
+    lodMorph = lodLevel - lambda;
+}
+
+// Re-tessellates adaptively for this eye/viewport if they changed
+void ensureAdaptiveMesh(const Vec3& eye, int h) {
+    float key[4] = { eye.x, eye.y, eye.z, (float)h };
+    if (meshRes == -1 && std::equal(key, key + 4, adaptiveKey)) return;
+    std::copy(key, key + 4, adaptiveKey);
+
+    AdaptiveView view = { { eye.x, eye.y, eye.z }, h / (2.0f * tanf(45.0f * (float)M_PI / 360.0f)), adaptivePixelTol };
+    AdaptiveMesh m;
+    {
+        ProfileScope scope("tessellateAdaptive");
+        tessellateAdaptive(ctrlSoA(), view, m);
+    }
+    size_t nv = m.uv.size() / 2;
+    verts.resize(nv);
+    for (size_t k = 0; k < nv; k++)
+        verts[k] = { m.pos[3 * k], m.pos[3 * k + 1], m.pos[3 * k + 2],
+                     m.nrm[3 * k], m.nrm[3 * k + 1], m.nrm[3 * k + 2], m.uv[2 * k], m.uv[2 * k + 1] };
+    inds.swap(m.inds);
+    upload();
+    clusterMesh(verts.data(), inds.data(), inds.size());
+    meshRes = -1; // not a uniform grid any more
+}
+
 void display() {
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glEnable(GL_DEPTH_TEST);
 
     // Camera math (compute matrices manually)
-    int w = glutGet(GLUT_WINDOW_WIDTH), h = glutGet(GLUT_WINDOW_HEIGHT);
+    int w = headless().active() ? headless().width() : glutGet(GLUT_WINDOW_WIDTH);
+    int h = headless().active() ? headless().height() : glutGet(GLUT_WINDOW_HEIGHT);
     float pitchR = camPitchDeg * M_PI / 180.0f;
     float yawR   = camYawDeg * M_PI / 180.0f;
     Vec3 eye( camDistVal * cosf(pitchR) * cosf(yawR),
@@ -359,48 +841,116 @@ void display() {
 
     Mat4 proj = perspective(45.0f, (float)w/(float)h, 0.1f, 100.0f);
     Mat4 view = lookAt(eye, center, up);
-    Mat4 model = mat_identity();
-    Mat4 viewModel = mat_mul(view, model);
-
-    // compute normal matrix (inverse-transpose of upper-left 3x3 of viewModel)
-    float vm3[9]; mat4_to_mat3(viewModel, vm3);
-    float inv3[9];
-    bool ok = invert_mat3(vm3, inv3);
-    float normalMat[9];
-    if (ok) transpose3(inv3, normalMat); // inverse-transpose -> transpose(inverse(M))
-    else {
-        // fallback: use upper-left 3x3 of viewModel (not ideal for non-uniform scale)
-        std::copy(vm3, vm3+9, normalMat);
-    }
+    Mat4 model = modelFit();
+    // inverse-transpose of the upper-left 3x3 of view * model
+    Mat3 normalMat = normalMatrix(view * model);
 
-    glUseProgram(prog);
-    GLint locModel = glGetUniformLocation(prog, "uModel");
-    GLint locView = glGetUniformLocation(prog, "uView");
-    GLint locProj = glGetUniformLocation(prog, "uProj");
-    GLint locNormal = glGetUniformLocation(prog, "uNormalMat");
+    // bring the CPU mesh up to date first: its upload decides the
+    // dequantization uniforms below
+    if (!useGpuTess) {
+        if (useAdaptive) ensureAdaptiveMesh(eye, h);
+        else if (lodActive()) selectLod(eye, h);
+        else ensureCpuMesh();
+    }
 
-    glUniformMatrix4fv(locModel, 1, GL_FALSE, model.m);
-    glUniformMatrix4fv(locView,  1, GL_FALSE, view.m);
-    glUniformMatrix4fv(locProj,  1, GL_FALSE, proj.m);
-    glUniformMatrix3fv(locNormal, 1, GL_FALSE, normalMat);
+    CameraBlock cam = {};
+    std::copy(model.m, model.m + 16, cam.model);
+    std::copy(view.m, view.m + 16, cam.view);
+    std::copy(proj.m, proj.m + 16, cam.proj);
+    std::copy(normalMat.m, normalMat.m + 12, cam.normalMat);
+    cameraBlock.update(cam);
 
     // lighting & material
-    glUniform3f(glGetUniformLocation(prog, "uLightPosView"), 0.0f, 0.0f, 0.0f);
-    glUniform3f(glGetUniformLocation(prog, "uLightColor"), 1.0f, 1.0f, 1.0f);
-    glUniform3f(glGetUniformLocation(prog, "uSpecular"), 0.6f, 0.6f, 0.6f);
-    glUniform3f(glGetUniformLocation(prog, "uAmbient"), 0.12f, 0.12f, 0.12f);
-    glUniform1f(glGetUniformLocation(prog, "uShininess"), 32.0f);
-    glUniform1i(glGetUniformLocation(prog, "uTex"), 0);
-    glUniform1i(glGetUniformLocation(prog, "uUseTexture"), useTex ? 1 : 0);
+    MaterialBlock mat = { { 0.0f, 0.0f, 0.0f }, 0, { 1.0f, 1.0f, 1.0f }, 0, { 0.6f, 0.6f, 0.6f }, 0,
+                          { 0.12f, 0.12f, 0.12f }, 32.0f, useTex ? 1 : 0, { 0, 0, 0 } };
+    materialBlock.update(mat);
 
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, tex);
 
-    glBindVertexArray(vao);
-    glDrawElements(GL_TRIANGLES, (GLsizei)inds.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    if (useGpuTess) {
+        ProfileScope scope("drawGpuTess", true);
+        // RES samples per side = RES - 1 segments, split into tiles the
+        // hardware can generate
+        int segs = RES - 1;
+        int tiles = (segs + maxTessLevel - 1) / maxTessLevel;
+        tessProg.use();
+        glUniform1f(locTessLevel, (float)segs / tiles);
+        glUniform1i(locTiles, tiles);
+        glPatchParameteri(GL_PATCH_VERTICES, 16);
+        glBindVertexArray(patchVao);
+        glDrawArraysInstanced(GL_PATCHES, 0, 16 * std::max(1, patchModel.patchCount), tiles * tiles);
+        headless().addWork(2.0 * segs * segs * std::max(1, patchModel.patchCount));
+        glBindVertexArray(0);
+    }
+    else {
+        ProfileScope scope("draw", true);
+        prog.use();
+        bool lod = lodActive();
+        GLenum mode = drawMode, type = drawIndexType;
+        GLsizei count = indexCount;
+        int gridRes = RES; // strips only ever hold a grid
+        if (lod) {
+            // static float vertices in arrays of their own; vao keeps its mesh
+            gridRes = (LOD_BASE_SEGS << lodLevel) + 1;
+            const GridIndices& g = gridIndices(gridRes, useStrips);
+            glBindVertexArray(lodVao[lodLevel]);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g.ebo);
+            mode = useStrips ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+            type = g.type;
+            count = g.count;
+            glUniform3f(locPosScale, 1.0f, 1.0f, 1.0f);
+            glUniform3f(locPosBias, 0.0f, 0.0f, 0.0f);
+            glUniform1i(locGridRes, 0);
+        }
+        else {
+            glUniform3fv(locPosScale, 1, posScale);
+            glUniform3fv(locPosBias, 1, posBias);
+            glUniform1i(locGridRes, uvGridRes);
+            glBindVertexArray(vao);
+        }
+        glUniform1f(locMorph, lod ? lodMorph : 0.0f);
+        const ClusteredIndices& cl = lod ? lodClusters[lodLevel] : meshClusters;
+        bool culled = false;
+        size_t kept = 0;
+        if (useCulling && !cl.clusters.empty()) {
+            // frustum and eye in the mesh's own space
+            Frustum frustum = frustumFromMatrix(proj * view * model);
+            Mat3 invModel = Mat3::identity();
+            inverse(upperLeft3(model), invModel);
+            Vec3 eyeModel = transformVector(invModel, eye - Vec3(model.m[12], model.m[13], model.m[14]));
+            kept = cullClusters(cl.clusters, frustum, eyeModel, true, clusterCounts, clusterOffsets);
+            const MeshCluster& lastCluster = cl.clusters.back();
+            size_t total = lastCluster.firstIndex + lastCluster.indexCount;
+            culled = mode == GL_TRIANGLES || kept <= CLUSTER_MAX_KEPT * total;
+            clusterIndicesKept += culled ? kept : total;
+            clusterIndicesTotal += total;
+        }
+        if (culled) {
+            GLint meshEbo = 0;
+            glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &meshEbo);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cl.ebo);
+            glMultiDrawElements(GL_TRIANGLES, clusterCounts.data(), GL_UNSIGNED_INT, clusterOffsets.data(),
+                                (GLsizei)clusterCounts.size());
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, meshEbo);
+            headless().addWork(kept / 3.0);
+        }
+        else {
+            if (mode == GL_TRIANGLE_STRIP) {
+                glEnable(GL_PRIMITIVE_RESTART);
+                glPrimitiveRestartIndex(type == GL_UNSIGNED_SHORT ? 0xFFFFu : 0xFFFFFFFFu);
+            }
+            glDrawElements(mode, count, type, 0);
+            headless().addWork(mode == GL_TRIANGLES ? count / 3.0 : 2.0 * (gridRes - 1) * (gridRes - 1));
+            glDisable(GL_PRIMITIVE_RESTART);
+        }
+        glBindVertexArray(0);
+        if (!lod) vertexStream->use(vertexOffset, vertexBytes);
+    }
+    vertexStream->fence();
 
-    glutSwapBuffers();
+    if (!headless().active()) glutSwapBuffers();
+    frameProfiler().endFrame();
 }
 
 void keys(unsigned char k, int, int) {
@@ -408,8 +958,39 @@ void keys(unsigned char k, int, int) {
     if (k == 'w') camDistVal = std::max(0.5f, camDistVal - 0.3f);
     if (k == 's') camDistVal += 0.3f;
     if (k == 't') { useTex = !useTex; std::cout << "Texture " << (useTex ? "ON" : "OFF") << "\n"; }
-    if (k == '+' || k == '=') { RES = std::min(128, RES + 4); buildMesh(); upload(); }
-    if (k == '-' || k == '_') { RES = std::max(4, RES - 4); buildMesh(); upload(); }
+    if (k == '+' || k == '=') RES = std::min(128, RES + 4);
+    if (k == '-' || k == '_') RES = std::max(4, RES - 4);
+    if ((k == '+' || k == '=' || k == '-' || k == '_') && lodActive())
+        std::cout << "RES only applies with LOD off (L)\n";
+    if (k == 'k') {
+        useCulling = !useCulling;
+        if (useCulling) meshRes = 0; // cluster the current mesh
+        std::cout << "Cluster culling " << (useCulling ? "ON" : "OFF") << "\n";
+    }
+    if (k == 'l') {
+        if (patchModel.patchCount > 0) std::cout << "LOD works on the single patch only\n";
+        else useLod = !useLod;
+        std::cout << "Distance-based LOD " << (useLod ? "ON" : "OFF") << "\n";
+    }
+    if (k == 'c') {
+        compactVerts = !compactVerts;
+        meshRes = 0; // re-upload (grid or adaptive) in the other format
+        std::cout << "Vertex format: " << (compactVerts ? "compact (12-16 bytes)" : "float (32 bytes)") << "\n";
+    }
+    if (k == 'i') {
+        useStrips = !useStrips;
+        std::cout << "Grid indices: " << (useStrips ? "strips + primitive restart" : "triangle list") << "\n";
+    }
+    if (k == 'a') {
+        if (patchModel.patchCount > 0) std::cout << "Adaptive tessellation works on the single patch only\n";
+        else useAdaptive = !useAdaptive;
+        std::cout << "Adaptive tessellation " << (useAdaptive ? "ON" : "OFF") << "\n";
+    }
+    if (k == 'g') {
+        if (!tessSupported) std::cout << "GPU tessellation needs OpenGL 4.0\n";
+        else useGpuTess = !useGpuTess;
+        std::cout << "Tessellation: " << (useGpuTess ? "GPU" : "CPU") << "\n";
+    }
     glutPostRedisplay();
 }
 void special(int key, int, int) {
@@ -423,14 +1004,41 @@ void special(int key, int, int) {
 void init() {
     glewExperimental = GL_TRUE;
     GLenum err = glewInit();
-    if (err != GLEW_OK) {
+    if (!glewInitOk(err)) {
         std::cerr << "GLEW init error: " << glewGetErrorString(err) << std::endl;
         exit(1);
     }
 
-    GLuint vs = compile(GL_VERTEX_SHADER, vsSrc);
-    GLuint fs = compile(GL_FRAGMENT_SHADER, fsSrc);
-    prog = link(vs, fs);
+    if (!prog.build({ { GL_VERTEX_SHADER, vsSrc }, { GL_FRAGMENT_SHADER, fsSrc } })) exit(1);
+    locPosScale = prog.uniform("uPosScale");
+    locPosBias = prog.uniform("uPosBias");
+    locGridRes = prog.uniform("uGridRes");
+    locMorph = prog.uniform("uMorph");
+    prog.bindBlock("Camera", CAMERA_BINDING);
+    prog.bindBlock("Material", MATERIAL_BINDING);
+    prog.use();
+    glUniform1i(prog.uniform("uTex"), 0);
+
+    // the tessellation stages are #version 400 core; without GL 4.0, or if
+    // they fail to build, the CPU mesh is all there is
+    tessSupported = GLEW_VERSION_4_0 &&
+                    tessProg.build({ { GL_VERTEX_SHADER, tessVsSrc }, { GL_TESS_CONTROL_SHADER, tessTcsSrc },
+                                     { GL_TESS_EVALUATION_SHADER, tessTesSrc }, { GL_FRAGMENT_SHADER, fsSrc } });
+    if (tessSupported) {
+        locTessLevel = tessProg.uniform("uTessLevel");
+        locTiles = tessProg.uniform("uTiles");
+        tessProg.bindBlock("Camera", CAMERA_BINDING);
+        tessProg.bindBlock("Material", MATERIAL_BINDING);
+        tessProg.use();
+        glUniform1i(tessProg.uniform("uTex"), 0);
+        glGetIntegerv(GL_MAX_TESS_GEN_LEVEL, &maxTessLevel);
+        uploadPatch();
+    }
+    glUseProgram(0);
+    cameraBlock.create(CAMERA_BINDING);
+    materialBlock.create(MATERIAL_BINDING);
+
+    vertexStream = new StreamBuffer(GL_ARRAY_BUFFER, 8 << 20);
 
     makeTex();
     glEnable(GL_CULL_FACE);
@@ -438,29 +1046,98 @@ void init() {
     glEnable(GL_DEPTH_TEST);
 }
 
+// Scripted input for -headless: the camera orbits and bobs for the whole
+// run while each fifth takes another path through the renderer: grid with
+// strips, compact vertices with triangle lists, adaptive tessellation (single
+// patch only), GPU tessellation when available, then the LOD chain while
+// the camera flies out to 40 units and back. RES sweeps 8..128 every 8
+// frames, so mesh rebuilds and uploads are part of the numbers.
+void headlessScript(int frame, int frames) {
+    int phase = 5 * frame / frames;
+    camYawDeg = 45.0f + 360.0f * frame / frames;
+    camPitchDeg = 20.0f + 15.0f * sinf(frame * 0.05f);
+    camDistVal = 6.0f + 2.0f * sinf(frame * 0.03f);
+    RES = 8 + 4 * (frame / 8 % 31);
+    if (compactVerts != (phase == 1)) {
+        compactVerts = phase == 1;
+        meshRes = 0;
+    }
+    useStrips = phase != 1;
+    useAdaptive = phase == 2 && patchModel.patchCount == 0;
+    useGpuTess = phase == 3 && tessSupported;
+    useLod = phase == 4;
+    if (useLod) camDistVal = 4.0f + 36.0f * sinf((float)M_PI * (5.0f * frame / frames - 4.0f));
+}
+
 // main
 int main(int argc, char** argv) {
+    bool offscreen = headless().parse(argc, argv);
+    if (!offscreen) glutInit(&argc, argv);
+
+    // optional multi-patch model, e.g. ./bezier_patch_modern teapot.bpt
+    const char* modelFile = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-nocache") == 0) useMeshCache = programCacheEnabled = false;
+        else if (strcmp(argv[i], "-profile") == 0) frameProfiler().enable("task3_trace.json");
+        else if (strcmp(argv[i], "-headless") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) i++;
+        else if (argv[i][0] != '-' && !modelFile) modelFile = argv[i];
+    }
+    if (modelFile && !loadBpt(modelFile, patchModel))
+        std::cerr << "Could not load model " << modelFile << ", using the single patch\n";
+
     if (!loadControlPointsFromFile("patchPoints.txt"))
         setDefaultControlPoints();
-    buildMesh();
 
-    glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
-    glutInitWindowSize(1000, 700);
-    glutCreateWindow("Bezier Patch (modern matrices)");
+    if (offscreen) {
+        if (!headless().createContext()) return 1;
+    }
+    else {
+        glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
+        glutInitWindowSize(1000, 700);
+        glutCreateWindow("Bezier Patch (modern matrices)");
+    }
 
     init();
-    upload();
+    if (offscreen && !headless().createTarget(1000, 700)) return 1;
+    ensureCpuMesh();
+
+    std::cout << "Patch evaluation: " << simdLevelName(bezierSimdLevel())
+        << ", " << jobPool().threadCount() << " thread(s)\n";
+    if (patchModel.patchCount > 0)
+        std::cout << "Model: " << patchModel.patchCount << " patches\n";
+
+    if (offscreen) {
+        while (headless().nextFrame()) {
+            headlessScript(headless().frame(), headless().frameCount());
+            display();
+        }
+        headless().report("task3", "triangles");
+        if (clusterIndicesTotal > 0)
+            printf("  cluster culling: %.1f%% of the clustered triangles drawn\n",
+                   100.0 * clusterIndicesKept / clusterIndicesTotal);
+        headless().destroy();
+        return 0;
+    }
+
     glutDisplayFunc(display);
     glutKeyboardFunc(keys);
     glutSpecialFunc(special);
-
     std::cout << "Controls:\n"
         << "  Arrow keys: rotate camera\n"
         << "  W/S: zoom in/out\n"
-        << "  +/- : increase/decrease tessellation\n"
+        << "  +/- : increase/decrease tessellation (with LOD off)\n"
+        << "  L: toggle distance-based LOD with geomorphing (single patch)\n"
+        << "  K: toggle frustum and back-face cluster culling\n"
         << "  T: toggle texture\n"
-        << "  Q or Esc: quit\n";
+        << "  G: toggle GPU tessellation (OpenGL 4.0)\n"
+        << "  A: toggle screen-space adaptive tessellation\n"
+        << "  I: toggle triangle strips / triangle list for the grid\n"
+        << "  C: toggle compact vertex format\n"
+        << "  Q or Esc: quit\n"
+        << "Tessellated meshes are cached in mesh_cache/, linked shaders in shader_cache/\n"
+        << "(run with -nocache to skip both)\n"
+        << "Run with -profile to print per-phase CPU/GPU times and write task3_trace.json on exit\n"
+        << "Run with -headless [frames] to benchmark a scripted run offscreen without a window\n";
 
     glutMainLoop();
     return 0;
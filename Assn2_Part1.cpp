@@ -1,6 +1,12 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "frame_profiler.h"
+#include "gl_program.h"
+#include "headless.h"
+#include "stream_buffer.h"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <vector>
 #include <iostream>
 #include <map>
@@ -27,6 +33,10 @@ GLFWwindow* mainWindow = nullptr;
 GLFWwindow* subWindow = nullptr;
 GLFWwindow* window2 = nullptr;
 
+// Stand-ins for the three windows in a -headless run: one context, three
+// framebuffers of the windows' sizes
+OffscreenTarget mainTarget, subTarget, window2Target;
+
 // Subwindow background color
 float subWindowBgColor[3] = {0.2f, 0.2f, 0.5f}; // Blue-gray
 
@@ -48,6 +58,11 @@ struct MenuItem {
 std::vector<MenuItem> menuItems;
 bool squareColorsSubmenu = false;
 
+// Vertices rebuilt every frame (animated shapes, menu) are written into this
+// ring instead of re-specifying a buffer per shape with glBufferData
+StreamBuffer* shapeStream = nullptr;
+const size_t VERTEX_STRIDE = 5 * sizeof(float);
+
 const char* vertexShaderSrc = R"glsl(
 #version 330 core
 layout (location = 0) in vec2 vPosition;
@@ -68,41 +83,6 @@ void main() {
 }
 )glsl";
 
-GLuint compileShaderProgram() {
-    auto compile = [](const char* src, GLenum type) {
-        GLuint shader = glCreateShader(type);
-        glShaderSource(shader, 1, &src, nullptr);
-        glCompileShader(shader);
-        GLint success;
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-        if (!success) {
-            char info[512];
-            glGetShaderInfoLog(shader, 512, nullptr, info);
-            std::cerr << "Shader compile error:\n" << info << std::endl;
-        }
-        return shader;
-    };
-
-    GLuint vert = compile(vertexShaderSrc, GL_VERTEX_SHADER);
-    GLuint frag = compile(fragmentShaderSrc, GL_FRAGMENT_SHADER);
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, vert);
-    glAttachShader(prog, frag);
-    glLinkProgram(prog);
-    
-    GLint success;
-    glGetProgramiv(prog, GL_LINK_STATUS, &success);
-    if (!success) {
-        char info[512];
-        glGetProgramInfoLog(prog, 512, nullptr, info);
-        std::cerr << "Program link error:\n" << info << std::endl;
-    }
-    
-    glDeleteShader(vert);
-    glDeleteShader(frag);
-    return prog;
-}
-
 void createEllipse(std::vector<float>& data, int segments = 50) {
     float cx = 0.0f, cy = 0.0f;
     float rx = 0.2f, ry = 0.15f;
@@ -256,25 +236,26 @@ void drawMenu() {
     }
     
     static GLuint menuVAO = 0, menuVBO = 0;
-    if (menuVAO == 0) {
-        glGenVertexArrays(1, &menuVAO);
-        glGenBuffers(1, &menuVBO);
-    }
+    if (menuVAO == 0) glGenVertexArrays(1, &menuVAO);
     
-    glBindVertexArray(menuVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, menuVBO);
-    glBufferData(GL_ARRAY_BUFFER, menuData.size() * sizeof(float), menuData.data(), GL_STATIC_DRAW);
+    size_t offset = shapeStream->write(menuData.data(), menuData.size() * sizeof(float), VERTEX_STRIDE);
+    GLint first = (GLint)(offset / VERTEX_STRIDE);
     
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(2 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    glBindVertexArray(menuVAO);
+    if (menuVBO != shapeStream->id()) {
+        menuVBO = shapeStream->id();
+        glBindBuffer(GL_ARRAY_BUFFER, menuVBO);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(2 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+    }
     
     // Draw menu background
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    glDrawArrays(GL_TRIANGLE_FAN, first, 4);
     
     // Draw menu items
-    int currentVertex = 4; // After background
+    int currentVertex = first + 4; // After background
     for (size_t i = 0; i < menuItems.size(); i++) {
         // Draw item color block
         glDrawArrays(GL_TRIANGLE_FAN, currentVertex, 4);
@@ -312,6 +293,8 @@ struct Shape {
     GLuint vao, vbo;
     GLsizei vertexCount;
     GLenum mode;
+    GLint first;   // first vertex in vbo
+    bool streamed; // vbo is shapeStream's, not the shape's own
 };
 
 Shape setupVAO(const std::vector<float>& data, GLenum mode) {
@@ -334,13 +317,29 @@ Shape setupVAO(const std::vector<float>& data, GLenum mode) {
     return s;
 }
 
+// Streams the new vertices into shapeStream; the VAO only needs re-pointing
+// the first time and whenever the ring grows into a new buffer. VAOs are not
+// shared between contexts, so a shape without one gets it here, in the
+// context that draws it.
 void updateVAO(Shape& shape, const std::vector<float>& data, GLenum mode) {
+    ProfileScope scope("updateVAO");
     shape.vertexCount = data.size() / 5;
     shape.mode = mode;
     
+    size_t offset = shapeStream->write(data.data(), data.size() * sizeof(float), VERTEX_STRIDE);
+    shape.first = (GLint)(offset / VERTEX_STRIDE);
+    if (shape.vao && shape.vbo == shapeStream->id()) return;
+    
+    if (shape.vbo && !shape.streamed) glDeleteBuffers(1, &shape.vbo);
+    if (!shape.vao) glGenVertexArrays(1, &shape.vao);
+    shape.vbo = shapeStream->id();
+    shape.streamed = true;
     glBindVertexArray(shape.vao);
     glBindBuffer(GL_ARRAY_BUFFER, shape.vbo);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), data.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
     glBindVertexArray(0);
 }
 
@@ -507,10 +506,41 @@ void updateAnimations() {
     }
 }
 
-int main() {
+// Scripted input for -headless, repeating every 240 frames: open the menu,
+// pick a square colour from its submenu, stop and restart the animation;
+// window 2 changes colour every 60 frames
+void headlessScript(int frame) {
+    static const float palette[4][3] = { {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}, {1.0f, 1.0f, 1.0f} };
+    int t = frame % 240;
+    if (t == 0 || t == 120 || t == 180) {
+        menuX = menuY = 0.0f;
+        squareColorsSubmenu = false;
+        initMenu();
+        showMenu = true;
+    }
+    if (t == 40) handleMenuSelection(2);               // Colors
+    if (t == 80) handleMenuSelection(frame / 240 % 3); // White / Red / Green
+    if (t == 140) handleMenuSelection(0);              // Stop
+    if (t == 200) handleMenuSelection(1);              // Start
+    if (frame % 60 == 0) std::copy(palette[frame / 60 % 4], palette[frame / 60 % 4] + 3, circleColor);
+}
+
+// Makes a window's context current; a headless run binds its framebuffer
+void makeCurrent(GLFWwindow* window, const OffscreenTarget& target) {
+    if (headless().active()) target.bind();
+    else glfwMakeContextCurrent(window);
+    frameProfiler().setContext(window);
+}
+
+void present(GLFWwindow* window) {
+    if (!headless().active()) glfwSwapBuffers(window);
+}
+
+// Creates the three windows sharing the main window's objects and loads GL
+bool createWindows() {
     if (!glfwInit()) {
         std::cerr << "Failed to init GLFW\n";
-        return -1;
+        return false;
     }
     
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -526,7 +556,7 @@ int main() {
     if (!mainWindow) {
         std::cerr << "Failed to create main window\n";
         glfwTerminate();
-        return -1;
+        return false;
     }
 
     // Set up main window context first
@@ -534,7 +564,7 @@ int main() {
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         std::cerr << "Failed to initialize GLAD\n";
         glfwTerminate();
-        return -1;
+        return false;
     }
 
     // Create subwindow (ellipse window) - share context with main window
@@ -542,7 +572,7 @@ int main() {
     if (!subWindow) {
         std::cerr << "Failed to create sub window\n";
         glfwTerminate();
-        return -1;
+        return false;
     }
 
     // Create window2 (circle and triangle) - share context with main window
@@ -550,30 +580,49 @@ int main() {
     if (!window2) {
         std::cerr << "Failed to create window 2\n";
         glfwTerminate();
-        return -1;
+        return false;
     }
 
     // Set up callbacks
     glfwSetMouseButtonCallback(mainWindow, mouseButtonCallback);
     glfwSetKeyCallback(window2, keyCallback);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    // -profile: per-phase CPU/GPU times on exit plus a Chrome trace
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "-profile") == 0) frameProfiler().enable("assn2_trace.json");
+
+    bool offscreen = headless().parse(argc, argv);
+    if (offscreen) {
+        if (!headless().createContext(3, 3, true)) return -1;
+        if (!gladLoadGLLoader((GLADloadproc)HeadlessRun::procAddress)) {
+            std::cerr << "Failed to initialize GLAD\n";
+            return -1;
+        }
+        if (!mainTarget.create(WINDOW_WIDTH, WINDOW_HEIGHT) || !subTarget.create(400, 300) ||
+            !window2Target.create(400, 300))
+            return -1;
+    }
+    else if (!createWindows()) return -1;
 
     // Compile shader program (using main window context)
-    GLuint program = compileShaderProgram();
+    GLProgram program;
+    program.build({ { GL_VERTEX_SHADER, vertexShaderSrc }, { GL_FRAGMENT_SHADER, fragmentShaderSrc } });
+    shapeStream = new StreamBuffer(GL_ARRAY_BUFFER, 256 << 10);
 
     // Create shapes data for each window
-    std::vector<float> ellipseData, triData, circleData, squaresData;
+    std::vector<float> ellipseData, squaresData;
     
     createEllipse(ellipseData);
-    // Create triangle on the left side of window2
-    createTriangle(triData, 0.0f, -0.4f, 0.0f);
-    // Create circle on the right side of window2  
-    createCircle(circleData, 1.0f, 50, 0.4f, 0.0f);
     createNestedSquares(squaresData);
 
     // Setup VAOs for each window (using main window context)
     Shape ellipse = setupVAO(ellipseData, GL_TRIANGLE_FAN);
-    Shape triangle = setupVAO(triData, GL_TRIANGLES);
-    Shape circle = setupVAO(circleData, GL_TRIANGLE_FAN);
+    // window2's triangle and circle are streamed every frame; updateVAO makes
+    // their VAOs in window2's context
+    Shape triangle{}, circle{};
     Shape squares = setupVAO(squaresData, GL_TRIANGLE_STRIP);
 
     // Initialize menu
@@ -587,75 +636,101 @@ int main() {
     std::cout << "  - BLUE block: Change square colors" << std::endl;
     std::cout << "Window 2:" << std::endl;
     std::cout << "  - R,G,B,Y,O,P,W: Change circle/triangle colors" << std::endl;
+    std::cout << "Run with -headless [frames] to benchmark a scripted run offscreen" << std::endl;
     std::cout << "=================" << std::endl;
 
     // Main loop
-    while (!glfwWindowShouldClose(mainWindow)) {
+    while (offscreen ? headless().nextFrame() : !glfwWindowShouldClose(mainWindow)) {
+        if (offscreen) headlessScript(headless().frame());
         updateAnimations();
 
         // Update shapes with new transformations/colors
         std::vector<float> newTriData, newCircleData, newSquaresData;
-        
-        // Update triangle on the left with rotation
-        createTriangle(newTriData, triangleRotation, -0.4f, 0.0f);
-        // Update circle on the right with breathing animation
-        createCircle(newCircleData, circleScale, 50, 0.4f, 0.0f);
-        createNestedSquares(newSquaresData, squareRotation);
-        
-        // Update VAOs (using main window context)
-        glfwMakeContextCurrent(mainWindow);
-        updateVAO(triangle, newTriData, GL_TRIANGLES);
-        updateVAO(circle, newCircleData, GL_TRIANGLE_FAN);
-        updateVAO(squares, newSquaresData, GL_TRIANGLE_STRIP);
-
-        // Render main window (black & white squares only)
-        glfwMakeContextCurrent(mainWindow);
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        glUseProgram(program);
-        
-        glBindVertexArray(squares.vao);
-        for (int i = 0; i < 6; i++)
-            glDrawArrays(squares.mode, i * 4, 4);
-        
-        // Draw menu if visible
-        if (showMenu) {
-            drawMenu();
+        {
+            ProfileScope scope("geometry");
+            // Update triangle on the left with rotation
+            createTriangle(newTriData, triangleRotation, -0.4f, 0.0f);
+            // Update circle on the right with breathing animation
+            createCircle(newCircleData, circleScale, 50, 0.4f, 0.0f);
+            createNestedSquares(newSquaresData, squareRotation);
         }
         
-        glfwSwapBuffers(mainWindow);
+        // Render main window (black & white squares only). Each window
+        // streams the vertices it draws and fences them in its own context,
+        // since a fence only tracks the commands of the context it was made in.
+        makeCurrent(mainWindow, mainTarget);
+        {
+            ProfileScope scope("renderMain", true);
+            updateVAO(squares, newSquaresData, GL_TRIANGLE_STRIP);
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            program.use();
+            
+            glBindVertexArray(squares.vao);
+            for (int i = 0; i < 6; i++)
+                glDrawArrays(squares.mode, squares.first + i * 4, 4);
+            
+            // Draw menu if visible
+            if (showMenu) {
+                drawMenu();
+            }
+            
+            shapeStream->fence();
+        }
+        present(mainWindow);
 
         // Render subwindow (ellipse with custom background)
-        glfwMakeContextCurrent(subWindow);
-        glClearColor(subWindowBgColor[0], subWindowBgColor[1], subWindowBgColor[2], 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        glUseProgram(program);
-        
-        glBindVertexArray(ellipse.vao);
-        glDrawArrays(ellipse.mode, 0, ellipse.vertexCount);
-        glfwSwapBuffers(subWindow);
+        makeCurrent(subWindow, subTarget);
+        {
+            ProfileScope scope("renderSub", true);
+            glClearColor(subWindowBgColor[0], subWindowBgColor[1], subWindowBgColor[2], 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            program.use();
+            
+            glBindVertexArray(ellipse.vao);
+            glDrawArrays(ellipse.mode, 0, ellipse.vertexCount);
+        }
+        present(subWindow);
 
         // Render window2 (circle and triangle separated)
-        glfwMakeContextCurrent(window2);
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f); // Dark background
-        glClear(GL_COLOR_BUFFER_BIT);
-        glUseProgram(program);
-        
-        // Draw triangle on the left
-        glBindVertexArray(triangle.vao);
-        glDrawArrays(triangle.mode, 0, triangle.vertexCount);
-        
-        // Draw circle on the right
-        glBindVertexArray(circle.vao);
-        glDrawArrays(circle.mode, 0, circle.vertexCount);
-        glfwSwapBuffers(window2);
+        makeCurrent(window2, window2Target);
+        {
+            ProfileScope scope("renderWindow2", true);
+            updateVAO(triangle, newTriData, GL_TRIANGLES);
+            updateVAO(circle, newCircleData, GL_TRIANGLE_FAN);
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f); // Dark background
+            glClear(GL_COLOR_BUFFER_BIT);
+            program.use();
+            
+            // Draw triangle on the left
+            glBindVertexArray(triangle.vao);
+            glDrawArrays(triangle.mode, triangle.first, triangle.vertexCount);
+            
+            // Draw circle on the right
+            glBindVertexArray(circle.vao);
+            glDrawArrays(circle.mode, circle.first, circle.vertexCount);
+            shapeStream->fence();
+        }
+        present(window2);
+        frameProfiler().endFrame();
 
         // Poll events
-        glfwPollEvents();
+        if (!offscreen) glfwPollEvents();
     }
 
     // Cleanup
-    glDeleteProgram(program);
+    if (offscreen) headless().report("Assn2_Part1");
+    else glfwMakeContextCurrent(mainWindow);
+    delete shapeStream;
+    program.destroy();
+
+    if (offscreen) {
+        mainTarget.destroy();
+        subTarget.destroy();
+        window2Target.destroy();
+        headless().destroy();
+        return 0;
+    }
 
     glfwDestroyWindow(mainWindow);
     glfwDestroyWindow(subWindow);
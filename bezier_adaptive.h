@@ -0,0 +1,201 @@
+// bezier_adaptive.h
+// Screen-space-error adaptive tessellation of one bicubic Bezier patch.
+//
+// The (u,v) square is split as a quadtree: a node is subdivided while the
+// chordal error of its bilinear approximation, projected to pixels at the
+// node's distance from the eye, exceeds the tolerance. The tree is then
+// balanced so edge-adjacent leaves differ by at most one level, and each leaf
+// that borders finer leaves is fanned around its centre through the shared
+// edge midpoints. Leaves therefore meet without T-junctions or cracks, and
+// vertices at equal (u,v) are shared.
+//
+// Needs bezier_simd.h for the patch evaluation.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "bezier_simd.h"
+
+struct AdaptiveView {
+    float eye[3];        // camera position in patch space
+    float pixelsPerUnit; // viewport height / (2 tan(fovy / 2))
+    float pixelTolerance;
+};
+
+// Indexed triangle list; per vertex 2 floats in uv, 3 in pos and nrm
+struct AdaptiveMesh {
+    std::vector<float> uv, pos, nrm;
+    std::vector<unsigned int> inds;
+};
+
+class AdaptiveTessellator {
+public:
+    AdaptiveTessellator(const PatchSoA& patch, const AdaptiveView& view, int minDepth, int maxDepth)
+        : p(patch), view(view), minDepth(minDepth), maxDepth(maxDepth), F(1 << maxDepth),
+          depth((size_t)F * F, 0) {}
+
+    void run(AdaptiveMesh& out) {
+        subdivide(0, 0, 0);
+        balance();
+        triangulate(out);
+    }
+
+private:
+    const PatchSoA& p;
+    AdaptiveView view;
+    int minDepth, maxDepth;
+    int F;                          // finest cells per side
+    std::vector<unsigned char> depth; // leaf depth covering each finest cell
+
+    int depthAt(int x, int y) const { return depth[(size_t)y * F + x]; }
+
+    void fill(int x, int y, int size, int d) {
+        for (int j = y; j < y + size; j++)
+            std::fill(depth.begin() + (size_t)j * F + x, depth.begin() + (size_t)j * F + x + size, (unsigned char)d);
+    }
+
+    // Projected chordal error (pixels) of the bilinear quad spanning the node
+    float projectedError(int x, int y, int size) const {
+        float u0 = x / float(F), v0 = y / float(F), h = size / float(F);
+        float us[9] = { u0, u0 + h, u0 + h, u0,     u0 + h / 2, u0 + h,     u0 + h / 2, u0,         u0 + h / 2 };
+        float vs[9] = { v0, v0,     v0 + h, v0 + h, v0,         v0 + h / 2, v0 + h,     v0 + h / 2, v0 + h / 2 };
+        float px[9], py[9], pz[9];
+        PatchSamples s = { px, py, pz, nullptr, nullptr, nullptr };
+        evalPatchBatch(p, us, vs, 9, s);
+        // bilinear estimates: edge midpoints from two corners, centre from four
+        static const int e[4][2] = { { 0, 1 }, { 1, 2 }, { 2, 3 }, { 3, 0 } };
+        float err = 0;
+        for (int k = 0; k < 5; k++) {
+            float bx, by, bz;
+            if (k < 4) {
+                bx = 0.5f * (px[e[k][0]] + px[e[k][1]]);
+                by = 0.5f * (py[e[k][0]] + py[e[k][1]]);
+                bz = 0.5f * (pz[e[k][0]] + pz[e[k][1]]);
+            }
+            else {
+                bx = 0.25f * (px[0] + px[1] + px[2] + px[3]);
+                by = 0.25f * (py[0] + py[1] + py[2] + py[3]);
+                bz = 0.25f * (pz[0] + pz[1] + pz[2] + pz[3]);
+            }
+            float dx = px[4 + k] - bx, dy = py[4 + k] - by, dz = pz[4 + k] - bz;
+            err = std::max(err, dx * dx + dy * dy + dz * dz);
+        }
+        err = sqrtf(err);
+
+        // distance from the eye to the closest point of the node's bounding sphere
+        float cx = px[8], cy = py[8], cz = pz[8], r = 0;
+        for (int k = 0; k < 4; k++) {
+            float dx = px[k] - cx, dy = py[k] - cy, dz = pz[k] - cz;
+            r = std::max(r, dx * dx + dy * dy + dz * dz);
+        }
+        float ex = cx - view.eye[0], ey = cy - view.eye[1], ez = cz - view.eye[2];
+        float dist = std::max(1e-3f, sqrtf(ex * ex + ey * ey + ez * ez) - sqrtf(r));
+        return err * view.pixelsPerUnit / dist;
+    }
+
+    void subdivide(int x, int y, int d) {
+        int size = F >> d;
+        bool split = d < maxDepth && (d < minDepth || projectedError(x, y, size) > view.pixelTolerance);
+        if (!split) { fill(x, y, size, d); return; }
+        int h = size / 2;
+        subdivide(x, y, d + 1);
+        subdivide(x + h, y, d + 1);
+        subdivide(x, y + h, d + 1);
+        subdivide(x + h, y + h, d + 1);
+    }
+
+    // Split leaves until no edge neighbour is more than one level finer
+    void balance() {
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (int y = 0; y < F; y++)
+                for (int x = 0; x < F; x++) {
+                    int d = depthAt(x, y), size = F >> d;
+                    if (x % size || y % size) continue; // not a leaf origin
+                    int finest = 0;
+                    for (int k = 0; k < size; k++) {
+                        if (y > 0) finest = std::max(finest, depthAt(x + k, y - 1));
+                        if (y + size < F) finest = std::max(finest, depthAt(x + k, y + size));
+                        if (x > 0) finest = std::max(finest, depthAt(x - 1, y + k));
+                        if (x + size < F) finest = std::max(finest, depthAt(x + size, y + k));
+                    }
+                    if (finest > d + 1) { fill(x, y, size, d + 1); changed = true; }
+                }
+        }
+    }
+
+    // Vertices live on a 2F lattice so leaf centres of the finest cells fit
+    unsigned int vertex(int X, int Y, std::unordered_map<uint64_t, unsigned int>& ids, AdaptiveMesh& out) {
+        uint64_t key = ((uint64_t)(uint32_t)Y << 32) | (uint32_t)X;
+        auto it = ids.find(key);
+        if (it != ids.end()) return it->second;
+        unsigned int id = (unsigned int)(out.uv.size() / 2);
+        out.uv.push_back(X / float(2 * F));
+        out.uv.push_back(Y / float(2 * F));
+        ids.emplace(key, id);
+        return id;
+    }
+
+    void triangulate(AdaptiveMesh& out) {
+        out.uv.clear(); out.pos.clear(); out.nrm.clear(); out.inds.clear();
+        std::unordered_map<uint64_t, unsigned int> ids;
+        for (int y = 0; y < F; y++)
+            for (int x = 0; x < F; x++) {
+                int d = depthAt(x, y), size = F >> d;
+                if (x % size || y % size) continue;
+                // finer neighbour along an edge -> that edge gets its midpoint
+                bool mid[4] = {
+                    y > 0 && depthAt(x, y - 1) > d,           // bottom (v0)
+                    x + size < F && depthAt(x + size, y) > d, // right (u1)
+                    y + size < F && depthAt(x, y + size) > d, // top (v1)
+                    x > 0 && depthAt(x - 1, y) > d            // left (u0)
+                };
+                int X0 = 2 * x, Y0 = 2 * y, S = 2 * size, H = size;
+                unsigned int c00 = vertex(X0, Y0, ids, out), c10 = vertex(X0 + S, Y0, ids, out);
+                unsigned int c11 = vertex(X0 + S, Y0 + S, ids, out), c01 = vertex(X0, Y0 + S, ids, out);
+                if (!mid[0] && !mid[1] && !mid[2] && !mid[3]) {
+                    out.inds.insert(out.inds.end(), { c00, c10, c11, c00, c11, c01 });
+                    continue;
+                }
+                // counter-clockwise ring in (u,v), fanned around the centre
+                unsigned int ring[8];
+                int n = 0;
+                ring[n++] = c00;
+                if (mid[0]) ring[n++] = vertex(X0 + H, Y0, ids, out);
+                ring[n++] = c10;
+                if (mid[1]) ring[n++] = vertex(X0 + S, Y0 + H, ids, out);
+                ring[n++] = c11;
+                if (mid[2]) ring[n++] = vertex(X0 + H, Y0 + S, ids, out);
+                ring[n++] = c01;
+                if (mid[3]) ring[n++] = vertex(X0, Y0 + H, ids, out);
+                unsigned int c = vertex(X0 + H, Y0 + H, ids, out);
+                for (int k = 0; k < n; k++)
+                    out.inds.insert(out.inds.end(), { c, ring[k], ring[(k + 1) % n] });
+            }
+
+        // evaluate every unique vertex once
+        size_t nv = out.uv.size() / 2;
+        std::vector<float> us(nv), vs(nv), buf(nv * 6);
+        for (size_t k = 0; k < nv; k++) { us[k] = out.uv[2 * k]; vs[k] = out.uv[2 * k + 1]; }
+        PatchSamples s = { &buf[0], &buf[nv], &buf[2 * nv], &buf[3 * nv], &buf[4 * nv], &buf[5 * nv] };
+        evalPatchBatch(p, us.data(), vs.data(), nv, s);
+        out.pos.resize(nv * 3);
+        out.nrm.resize(nv * 3);
+        for (size_t k = 0; k < nv; k++) {
+            out.pos[3 * k] = s.px[k]; out.pos[3 * k + 1] = s.py[k]; out.pos[3 * k + 2] = s.pz[k];
+            out.nrm[3 * k] = s.nx[k]; out.nrm[3 * k + 1] = s.ny[k]; out.nrm[3 * k + 2] = s.nz[k];
+        }
+    }
+};
+
+// minDepth forces a few initial splits so a bump hidden between the sample
+// points of the root node is still found; maxDepth 7 matches RES 128.
+inline void tessellateAdaptive(const PatchSoA& p, const AdaptiveView& view, AdaptiveMesh& out,
+                               int minDepth = 1, int maxDepth = 7) {
+    AdaptiveTessellator(p, view, minDepth, maxDepth).run(out);
+}
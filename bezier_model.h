@@ -0,0 +1,241 @@
+// bezier_model.h
+// Multi-patch bicubic Bezier models (e.g. the Utah teapot .bpt files).
+//
+// .bpt layout: the patch count, then per patch a "3 3" degree line followed by
+// 16 control points "x y z", u varying fastest (the same order as
+// patchPoints.txt). All control points are kept in one contiguous array.
+//
+// tessellateModel() evaluates every patch on a res x res grid (patches run in
+// parallel on the job pool, each through the batch kernel) into one shared
+// vertex/index buffer, then welds vertices that coincide on patch borders.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+
+#include "bezier_simd.h"
+#include "job_pool.h"
+
+struct BezierModel {
+    int patchCount = 0;
+    std::vector<float> ctrl; // 48 floats per patch: point (i*4 + j) = ctrl[i][j], xyz
+
+    const float* patch(int p) const { return &ctrl[size_t(p) * 48]; }
+};
+
+// Vertex data of a tessellated model; 3 floats per vertex in pos/nrm, 2 in uv
+struct ModelMesh {
+    std::vector<float> pos, nrm, uv;
+    std::vector<unsigned int> inds;
+    size_t vertexCount() const { return pos.size() / 3; }
+};
+
+inline bool loadBpt(const char* fname, BezierModel& m) {
+    std::ifstream in(fname);
+    if (!in.is_open()) return false;
+    int n;
+    if (!(in >> n) || n <= 0) return false;
+    std::vector<float> ctrl(size_t(n) * 48);
+    for (int p = 0; p < n; p++) {
+        int du, dv;
+        if (!(in >> du >> dv)) return false;
+        if (du != 3 || dv != 3) {
+            std::cerr << fname << ": patch " << p << " is degree " << du << "x" << dv << ", only bicubic is supported\n";
+            return false;
+        }
+        for (int k = 0; k < 16; k++) {
+            int i = k % 4, j = k / 4;
+            float* c = &ctrl[size_t(p) * 48 + (i * 4 + j) * 3];
+            if (!(in >> c[0] >> c[1] >> c[2])) return false;
+        }
+    }
+    m.patchCount = n;
+    m.ctrl.swap(ctrl);
+    return true;
+}
+
+inline PatchSoA modelPatchSoA(const BezierModel& m, int p) {
+    PatchSoA s;
+    const float* c = m.patch(p);
+    for (int k = 0; k < 16; k++) {
+        s.x[k] = c[k * 3];
+        s.y[k] = c[k * 3 + 1];
+        s.z[k] = c[k * 3 + 2];
+    }
+    return s;
+}
+
+// Merges vertices on patch borders (u or v at 0 or 1) that lie within `eps`
+// of each other and have the same uv, and re-indexes; interior grid vertices
+// cannot coincide and are copied through. Candidates are bucketed on an eps
+// grid and matched against the 27 surrounding buckets, so near-equal
+// positions that round into different buckets still merge.
+//
+// Coinciding vertices with different uvs (one patch's u = 1 against the
+// next one's u = 0, or the points of a collapsed edge) stay apart so each
+// patch keeps its own texture coordinates, but all vertices at one position
+// share the averaged normal, so the shading is continuous across the seams.
+// Triangles left with two corners at one position have no area and are
+// dropped.
+inline void weldVertices(ModelMesh& mesh, float eps) {
+    size_t n = mesh.vertexCount();
+    std::vector<unsigned int> remap(n);
+    std::vector<unsigned int> group; // per output vertex: the first output vertex at its position
+    std::unordered_map<uint64_t, std::vector<unsigned int>> cells;
+    ModelMesh out;
+    out.pos.reserve(mesh.pos.size()); out.nrm.reserve(mesh.nrm.size()); out.uv.reserve(mesh.uv.size());
+    float inv = 1.0f / eps;
+    auto cellKey = [](int64_t x, int64_t y, int64_t z) {
+        return ((uint64_t)x & 0x1fffff) << 42 | ((uint64_t)y & 0x1fffff) << 21 | ((uint64_t)z & 0x1fffff);
+    };
+    for (size_t k = 0; k < n; k++) {
+        const float* p = &mesh.pos[k * 3];
+        const float* t = &mesh.uv[k * 2];
+        bool border = t[0] == 0.0f || t[0] == 1.0f || t[1] == 0.0f || t[1] == 1.0f;
+        int64_t cx = std::lround(p[0] * inv), cy = std::lround(p[1] * inv), cz = std::lround(p[2] * inv);
+        if (border) {
+            int match = -1, same = -1; // same position; same position and uv
+            for (int dz = -1; dz <= 1 && same < 0; dz++)
+                for (int dy = -1; dy <= 1 && same < 0; dy++)
+                    for (int dx = -1; dx <= 1 && same < 0; dx++) {
+                        auto it = cells.find(cellKey(cx + dx, cy + dy, cz + dz));
+                        if (it == cells.end()) continue;
+                        for (unsigned int id : it->second) {
+                            const float* q = &out.pos[id * 3];
+                            if (fabsf(q[0] - p[0]) > eps || fabsf(q[1] - p[1]) > eps || fabsf(q[2] - p[2]) > eps)
+                                continue;
+                            if (match < 0) match = (int)id;
+                            const float* w = &out.uv[id * 2];
+                            if (w[0] == t[0] && w[1] == t[1]) {
+                                same = (int)id;
+                                break;
+                            }
+                        }
+                    }
+            if (match >= 0) {
+                unsigned int g = group[match];
+                for (int c = 0; c < 3; c++) out.nrm[g * 3 + c] += mesh.nrm[k * 3 + c];
+                if (same >= 0) {
+                    remap[k] = (unsigned int)same;
+                    continue;
+                }
+                // a uv seam: a vertex of its own that takes the group's normal
+                unsigned int id = (unsigned int)out.vertexCount();
+                out.pos.insert(out.pos.end(), p, p + 3);
+                out.nrm.insert(out.nrm.end(), { 0.0f, 0.0f, 0.0f });
+                out.uv.insert(out.uv.end(), t, t + 2);
+                cells[cellKey(cx, cy, cz)].push_back(id);
+                group.push_back(g);
+                remap[k] = id;
+                continue;
+            }
+        }
+        unsigned int id = (unsigned int)out.vertexCount();
+        out.pos.insert(out.pos.end(), p, p + 3);
+        out.nrm.insert(out.nrm.end(), &mesh.nrm[k * 3], &mesh.nrm[k * 3] + 3);
+        out.uv.insert(out.uv.end(), t, t + 2);
+        if (border) cells[cellKey(cx, cy, cz)].push_back(id);
+        group.push_back(id);
+        remap[k] = id;
+    }
+    // normalize the group sums first, then copy them to the seam vertices
+    for (size_t k = 0; k < out.vertexCount(); k++) {
+        if (group[k] != k) continue;
+        float* N = &out.nrm[k * 3];
+        float L = sqrtf(N[0] * N[0] + N[1] * N[1] + N[2] * N[2]);
+        if (L > 1e-6f) { N[0] /= L; N[1] /= L; N[2] /= L; }
+    }
+    for (size_t k = 0; k < out.vertexCount(); k++)
+        if (group[k] != k)
+            for (int c = 0; c < 3; c++) out.nrm[k * 3 + c] = out.nrm[group[k] * 3 + c];
+    // triangles along collapsed patch edges now have two corners at one
+    // position; drop them
+    out.inds.reserve(mesh.inds.size());
+    for (size_t t = 0; t + 2 < mesh.inds.size(); t += 3) {
+        unsigned int a = remap[mesh.inds[t]], b = remap[mesh.inds[t + 1]], c = remap[mesh.inds[t + 2]];
+        unsigned int ga = group[a], gb = group[b], gc = group[c];
+        if (ga == gb || gb == gc || ga == gc) continue;
+        out.inds.push_back(a); out.inds.push_back(b); out.inds.push_back(c);
+    }
+    mesh.pos.swap(out.pos); mesh.nrm.swap(out.nrm); mesh.uv.swap(out.uv); mesh.inds.swap(out.inds);
+}
+
+// Every patch becomes a res x res vertex grid in its own slice of the buffers;
+// weld = true then merges the duplicated border vertices.
+inline void tessellateModel(const BezierModel& m, int res, ModelMesh& mesh, bool weld = true) {
+    size_t perPatchV = size_t(res) * res, perPatchI = size_t(res - 1) * (res - 1) * 6;
+    mesh.pos.resize(m.patchCount * perPatchV * 3);
+    mesh.nrm.resize(m.patchCount * perPatchV * 3);
+    mesh.uv.resize(m.patchCount * perPatchV * 2);
+    mesh.inds.resize(m.patchCount * perPatchI);
+
+    JobPool& pool = jobPool();
+    pool.parallelFor(0, m.patchCount, pool.grainFor(m.patchCount), [&](int p0, int p1) {
+        std::vector<float> us(perPatchV), vs(perPatchV), buf(perPatchV * 6);
+        for (int j = 0; j < res; j++)
+            for (int i = 0; i < res; i++) {
+                us[j * res + i] = i / float(res - 1);
+                vs[j * res + i] = j / float(res - 1);
+            }
+        size_t n = perPatchV;
+        PatchSamples s = { &buf[0], &buf[n], &buf[2 * n], &buf[3 * n], &buf[4 * n], &buf[5 * n] };
+        for (int p = p0; p < p1; p++) {
+            PatchSoA soa = modelPatchSoA(m, p);
+            for (int j = 0; j < res; j++) {
+                size_t r = size_t(j) * res;
+                PatchSamples row = { s.px + r, s.py + r, s.pz + r, s.nx + r, s.ny + r, s.nz + r };
+                evalPatchRow(soa, us.data(), vs[r], res, row);
+            }
+            size_t base = p * perPatchV;
+            for (size_t k = 0; k < n; k++) {
+                float* P = &mesh.pos[(base + k) * 3];
+                float* N = &mesh.nrm[(base + k) * 3];
+                P[0] = s.px[k]; P[1] = s.py[k]; P[2] = s.pz[k];
+                N[0] = s.nx[k]; N[1] = s.ny[k]; N[2] = s.nz[k];
+                mesh.uv[(base + k) * 2] = us[k];
+                mesh.uv[(base + k) * 2 + 1] = vs[k];
+            }
+            // collapsed edges (the teapot's poles) have no normal; take the
+            // one a hair inside the patch instead
+            std::vector<float> du, dv;
+            std::vector<size_t> fix;
+            for (size_t k = 0; k < n; k++) {
+                const float* N = &mesh.nrm[(base + k) * 3];
+                if (N[0] * N[0] + N[1] * N[1] + N[2] * N[2] > 0.5f) continue;
+                fix.push_back(k);
+                du.push_back(us[k] + (0.5f - us[k]) * 1e-3f);
+                dv.push_back(vs[k] + (0.5f - vs[k]) * 1e-3f);
+            }
+            if (!fix.empty()) {
+                evalPatchBatch(modelPatchSoA(m, p), du.data(), dv.data(), fix.size(), s);
+                for (size_t f = 0; f < fix.size(); f++) {
+                    float* N = &mesh.nrm[(base + fix[f]) * 3];
+                    N[0] = s.nx[f]; N[1] = s.ny[f]; N[2] = s.nz[f];
+                }
+            }
+
+            unsigned int* out = &mesh.inds[p * perPatchI];
+            for (int j = 0; j < res - 1; j++)
+                for (int i = 0; i < res - 1; i++) {
+                    unsigned int i00 = (unsigned int)(base + j * res + i);
+                    unsigned int i10 = i00 + 1;
+                    unsigned int i01 = i00 + res;
+                    unsigned int i11 = i01 + 1;
+                    out[0] = i00; out[1] = i10; out[2] = i11;
+                    out[3] = i00; out[4] = i11; out[5] = i01;
+                    out += 6;
+                }
+        }
+    });
+
+    if (!weld || mesh.pos.empty()) return;
+    float lo = mesh.pos[0], hi = mesh.pos[0];
+    for (float f : mesh.pos) { lo = std::min(lo, f); hi = std::max(hi, f); }
+    weldVertices(mesh, std::max(hi - lo, 1e-3f) * 1e-5f);
+}
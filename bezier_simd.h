@@ -0,0 +1,378 @@
+// bezier_simd.h
+// Structure-of-arrays batch evaluator for bicubic Bezier patches.
+// Evaluates position and analytic normal for many (u,v) pairs at once, using
+// AVX2 (8 lanes) or SSE (4 lanes) when the CPU supports it and a scalar loop
+// otherwise. All three paths perform the same operations in the same order, so
+// the SIMD results match the scalar ones (no FMA contraction is used).
+//
+// evalPatchRow() is the same evaluation for a row of samples sharing one v,
+// as in a tessellation grid: the net is collapsed against the v basis once
+// per row and the lanes only evaluate the u cubics, about a quarter of the
+// multiplies. Its results are identical to evalPatchBatch()'s.
+//
+// Header-only: include it from any of the patch programs, no extra link flags.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BEZIER_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define BEZIER_TARGET_SSE  __attribute__((target("sse2")))
+#define BEZIER_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define BEZIER_TARGET_SSE
+#define BEZIER_TARGET_AVX2
+#endif
+
+// Control net as three coordinate arrays; element [i*4 + j] is ctrl[i][j]
+struct PatchSoA { float x[16], y[16], z[16]; };
+
+// Output arrays, one entry per (u,v) pair. The normal pointers may be null when
+// only positions are needed.
+struct PatchSamples {
+    float *px, *py, *pz;
+    float *nx, *ny, *nz;
+};
+
+enum SimdLevel { SIMD_SCALAR = 0, SIMD_SSE = 1, SIMD_AVX2 = 2 };
+
+inline const char* simdLevelName(SimdLevel l) {
+    return l == SIMD_AVX2 ? "AVX2" : l == SIMD_SSE ? "SSE" : "scalar";
+}
+
+// Highest instruction set usable on this CPU (and OS, for AVX state saving)
+inline SimdLevel detectSimdLevel() {
+#if defined(BEZIER_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return SIMD_SSE;
+#elif defined(BEZIER_SIMD_X86) && defined(_MSC_VER)
+    int r[4];
+    __cpuid(r, 0);
+    int maxLeaf = r[0];
+    __cpuid(r, 1);
+    bool sse2 = (r[3] & (1 << 26)) != 0;
+    bool osxsave = (r[2] & (1 << 27)) != 0;
+    bool avx = (r[2] & (1 << 28)) != 0;
+    if (avx && osxsave && maxLeaf >= 7 && (_xgetbv(0) & 6) == 6) {
+        __cpuidex(r, 7, 0);
+        if (r[1] & (1 << 5)) return SIMD_AVX2;
+    }
+    if (sse2) return SIMD_SSE;
+#endif
+    return SIMD_SCALAR;
+}
+
+// ---- scalar reference ----------------------------------------------------
+
+// Stores position k and, when wanted, the unit normal Pu x Pv
+inline void storeSampleScalar(const PatchSamples& out, size_t k, const float P[3], const float Pu[3],
+                              const float Pv[3]) {
+    out.px[k] = P[0]; out.py[k] = P[1]; out.pz[k] = P[2];
+    if (!out.nx) return;
+    float nx = Pu[1] * Pv[2] - Pu[2] * Pv[1];
+    float ny = Pu[2] * Pv[0] - Pu[0] * Pv[2];
+    float nz = Pu[0] * Pv[1] - Pu[1] * Pv[0];
+    float L = sqrtf(nx * nx + ny * ny + nz * nz);
+    if (L > 1e-6f) { nx = nx / L; ny = ny / L; nz = nz / L; }
+    out.nx[k] = nx; out.ny[k] = ny; out.nz[k] = nz;
+}
+
+// One sample: collapse the net into four curves along v (C, and D = dC/dv),
+// then evaluate those along u. Every SIMD path below mirrors this sequence.
+inline void evalPatchScalar(const PatchSoA& p, const float* u, const float* v,
+                            size_t begin, size_t end, const PatchSamples& out) {
+    const float* cp[3] = { p.x, p.y, p.z };
+    for (size_t k = begin; k < end; k++) {
+        float U = u[k], V = v[k];
+        float om = 1 - U, omv = 1 - V;
+        float Bu[4] = { om * om * om, 3 * U * om * om, 3 * U * U * om, U * U * U };
+        float dBu[4] = { -3 * om * om, 3 * om * om - 6 * U * om, 6 * U * om - 3 * U * U, 3 * U * U };
+        float Bv[4] = { omv * omv * omv, 3 * V * omv * omv, 3 * V * V * omv, V * V * V };
+        float dBv[4] = { -3 * omv * omv, 3 * omv * omv - 6 * V * omv, 6 * V * omv - 3 * V * V, 3 * V * V };
+
+        float P[3], Pu[3], Pv[3];
+        for (int c = 0; c < 3; c++) {
+            const float* q = cp[c];
+            float C[4], D[4];
+            for (int i = 0; i < 4; i++) {
+                C[i] = q[i * 4] * Bv[0] + q[i * 4 + 1] * Bv[1] + q[i * 4 + 2] * Bv[2] + q[i * 4 + 3] * Bv[3];
+                D[i] = q[i * 4] * dBv[0] + q[i * 4 + 1] * dBv[1] + q[i * 4 + 2] * dBv[2] + q[i * 4 + 3] * dBv[3];
+            }
+            P[c]  = C[0] * Bu[0]  + C[1] * Bu[1]  + C[2] * Bu[2]  + C[3] * Bu[3];
+            Pu[c] = C[0] * dBu[0] + C[1] * dBu[1] + C[2] * dBu[2] + C[3] * dBu[3];
+            Pv[c] = D[0] * Bu[0]  + D[1] * Bu[1]  + D[2] * Bu[2]  + D[3] * Bu[3];
+        }
+        storeSampleScalar(out, k, P, Pu, Pv);
+    }
+}
+
+// The net collapsed against Bv(v) and dBv(v): per coordinate the four
+// control points of the u curve at v (C) and of its v derivative (D)
+struct PatchRow { float C[3][4], D[3][4]; };
+
+inline PatchRow collapsePatchRow(const PatchSoA& p, float V) {
+    const float* cp[3] = { p.x, p.y, p.z };
+    float omv = 1 - V;
+    float Bv[4] = { omv * omv * omv, 3 * V * omv * omv, 3 * V * V * omv, V * V * V };
+    float dBv[4] = { -3 * omv * omv, 3 * omv * omv - 6 * V * omv, 6 * V * omv - 3 * V * V, 3 * V * V };
+    PatchRow r;
+    for (int c = 0; c < 3; c++) {
+        const float* q = cp[c];
+        for (int i = 0; i < 4; i++) {
+            r.C[c][i] = q[i * 4] * Bv[0] + q[i * 4 + 1] * Bv[1] + q[i * 4 + 2] * Bv[2] + q[i * 4 + 3] * Bv[3];
+            r.D[c][i] = q[i * 4] * dBv[0] + q[i * 4 + 1] * dBv[1] + q[i * 4 + 2] * dBv[2] + q[i * 4 + 3] * dBv[3];
+        }
+    }
+    return r;
+}
+
+inline void evalPatchRowScalar(const PatchRow& r, const float* u, size_t begin, size_t end,
+                               const PatchSamples& out) {
+    for (size_t k = begin; k < end; k++) {
+        float U = u[k], om = 1 - U;
+        float Bu[4] = { om * om * om, 3 * U * om * om, 3 * U * U * om, U * U * U };
+        float dBu[4] = { -3 * om * om, 3 * om * om - 6 * U * om, 6 * U * om - 3 * U * U, 3 * U * U };
+        float P[3], Pu[3], Pv[3];
+        for (int c = 0; c < 3; c++) {
+            const float* C = r.C[c];
+            const float* D = r.D[c];
+            P[c]  = C[0] * Bu[0]  + C[1] * Bu[1]  + C[2] * Bu[2]  + C[3] * Bu[3];
+            Pu[c] = C[0] * dBu[0] + C[1] * dBu[1] + C[2] * dBu[2] + C[3] * dBu[3];
+            Pv[c] = D[0] * Bu[0]  + D[1] * Bu[1]  + D[2] * Bu[2]  + D[3] * Bu[3];
+        }
+        storeSampleScalar(out, k, P, Pu, Pv);
+    }
+}
+
+#ifdef BEZIER_SIMD_X86
+
+// ---- SSE, 4 lanes ----------------------------------------------------------
+
+BEZIER_TARGET_SSE inline void bezierBasisSSE(__m128 t, __m128 B[4], __m128 dB[4]) {
+    const __m128 one = _mm_set1_ps(1.0f), three = _mm_set1_ps(3.0f);
+    const __m128 six = _mm_set1_ps(6.0f), mthree = _mm_set1_ps(-3.0f);
+    __m128 om = _mm_sub_ps(one, t);
+    __m128 t3 = _mm_mul_ps(three, t), om3 = _mm_mul_ps(three, om);
+    B[0] = _mm_mul_ps(_mm_mul_ps(om, om), om);
+    B[1] = _mm_mul_ps(_mm_mul_ps(t3, om), om);
+    B[2] = _mm_mul_ps(_mm_mul_ps(t3, t), om);
+    B[3] = _mm_mul_ps(_mm_mul_ps(t, t), t);
+    dB[0] = _mm_mul_ps(_mm_mul_ps(mthree, om), om);
+    dB[1] = _mm_sub_ps(_mm_mul_ps(om3, om), _mm_mul_ps(_mm_mul_ps(six, t), om));
+    dB[2] = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(six, t), om), _mm_mul_ps(t3, t));
+    dB[3] = _mm_mul_ps(t3, t);
+}
+
+BEZIER_TARGET_SSE inline __m128 bezierDot4SSE(__m128 a0, __m128 a1, __m128 a2, __m128 a3, const __m128 w[4]) {
+    __m128 s = _mm_add_ps(_mm_mul_ps(a0, w[0]), _mm_mul_ps(a1, w[1]));
+    s = _mm_add_ps(s, _mm_mul_ps(a2, w[2]));
+    return _mm_add_ps(s, _mm_mul_ps(a3, w[3]));
+}
+
+BEZIER_TARGET_SSE inline void storeSamplesSSE(const PatchSamples& out, size_t k, const __m128 P[3],
+                                              const __m128 Pu[3], const __m128 Pv[3]) {
+    _mm_storeu_ps(out.px + k, P[0]);
+    _mm_storeu_ps(out.py + k, P[1]);
+    _mm_storeu_ps(out.pz + k, P[2]);
+    if (!out.nx) return;
+    __m128 nx = _mm_sub_ps(_mm_mul_ps(Pu[1], Pv[2]), _mm_mul_ps(Pu[2], Pv[1]));
+    __m128 ny = _mm_sub_ps(_mm_mul_ps(Pu[2], Pv[0]), _mm_mul_ps(Pu[0], Pv[2]));
+    __m128 nz = _mm_sub_ps(_mm_mul_ps(Pu[0], Pv[1]), _mm_mul_ps(Pu[1], Pv[0]));
+    __m128 L = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+    __m128 ok = _mm_cmpgt_ps(L, _mm_set1_ps(1e-6f));
+    nx = _mm_or_ps(_mm_and_ps(ok, _mm_div_ps(nx, L)), _mm_andnot_ps(ok, nx));
+    ny = _mm_or_ps(_mm_and_ps(ok, _mm_div_ps(ny, L)), _mm_andnot_ps(ok, ny));
+    nz = _mm_or_ps(_mm_and_ps(ok, _mm_div_ps(nz, L)), _mm_andnot_ps(ok, nz));
+    _mm_storeu_ps(out.nx + k, nx);
+    _mm_storeu_ps(out.ny + k, ny);
+    _mm_storeu_ps(out.nz + k, nz);
+}
+
+BEZIER_TARGET_SSE inline void evalPatchSSE(const PatchSoA& p, const float* u, const float* v,
+                                           size_t begin, size_t end, const PatchSamples& out) {
+    const float* cp[3] = { p.x, p.y, p.z };
+    size_t k = begin;
+    for (; k + 4 <= end; k += 4) {
+        __m128 Bu[4], dBu[4], Bv[4], dBv[4];
+        bezierBasisSSE(_mm_loadu_ps(u + k), Bu, dBu);
+        bezierBasisSSE(_mm_loadu_ps(v + k), Bv, dBv);
+        __m128 P[3], Pu[3], Pv[3];
+        for (int c = 0; c < 3; c++) {
+            const float* q = cp[c];
+            __m128 C[4], D[4];
+            for (int i = 0; i < 4; i++) {
+                __m128 q0 = _mm_set1_ps(q[i * 4]), q1 = _mm_set1_ps(q[i * 4 + 1]);
+                __m128 q2 = _mm_set1_ps(q[i * 4 + 2]), q3 = _mm_set1_ps(q[i * 4 + 3]);
+                C[i] = bezierDot4SSE(q0, q1, q2, q3, Bv);
+                D[i] = bezierDot4SSE(q0, q1, q2, q3, dBv);
+            }
+            P[c]  = bezierDot4SSE(C[0], C[1], C[2], C[3], Bu);
+            Pu[c] = bezierDot4SSE(C[0], C[1], C[2], C[3], dBu);
+            Pv[c] = bezierDot4SSE(D[0], D[1], D[2], D[3], Bu);
+        }
+        storeSamplesSSE(out, k, P, Pu, Pv);
+    }
+    evalPatchScalar(p, u, v, k, end, out);
+}
+
+BEZIER_TARGET_SSE inline void evalPatchRowSSE(const PatchRow& r, const float* u, size_t begin, size_t end,
+                                              const PatchSamples& out) {
+    __m128 C[3][4], D[3][4];
+    for (int c = 0; c < 3; c++)
+        for (int i = 0; i < 4; i++) {
+            C[c][i] = _mm_set1_ps(r.C[c][i]);
+            D[c][i] = _mm_set1_ps(r.D[c][i]);
+        }
+    size_t k = begin;
+    for (; k + 4 <= end; k += 4) {
+        __m128 Bu[4], dBu[4];
+        bezierBasisSSE(_mm_loadu_ps(u + k), Bu, dBu);
+        __m128 P[3], Pu[3], Pv[3];
+        for (int c = 0; c < 3; c++) {
+            P[c]  = bezierDot4SSE(C[c][0], C[c][1], C[c][2], C[c][3], Bu);
+            Pu[c] = bezierDot4SSE(C[c][0], C[c][1], C[c][2], C[c][3], dBu);
+            Pv[c] = bezierDot4SSE(D[c][0], D[c][1], D[c][2], D[c][3], Bu);
+        }
+        storeSamplesSSE(out, k, P, Pu, Pv);
+    }
+    evalPatchRowScalar(r, u, k, end, out);
+}
+
+// ---- AVX2, 8 lanes ---------------------------------------------------------
+
+BEZIER_TARGET_AVX2 inline void bezierBasisAVX2(__m256 t, __m256 B[4], __m256 dB[4]) {
+    const __m256 one = _mm256_set1_ps(1.0f), three = _mm256_set1_ps(3.0f);
+    const __m256 six = _mm256_set1_ps(6.0f), mthree = _mm256_set1_ps(-3.0f);
+    __m256 om = _mm256_sub_ps(one, t);
+    __m256 t3 = _mm256_mul_ps(three, t), om3 = _mm256_mul_ps(three, om);
+    B[0] = _mm256_mul_ps(_mm256_mul_ps(om, om), om);
+    B[1] = _mm256_mul_ps(_mm256_mul_ps(t3, om), om);
+    B[2] = _mm256_mul_ps(_mm256_mul_ps(t3, t), om);
+    B[3] = _mm256_mul_ps(_mm256_mul_ps(t, t), t);
+    dB[0] = _mm256_mul_ps(_mm256_mul_ps(mthree, om), om);
+    dB[1] = _mm256_sub_ps(_mm256_mul_ps(om3, om), _mm256_mul_ps(_mm256_mul_ps(six, t), om));
+    dB[2] = _mm256_sub_ps(_mm256_mul_ps(_mm256_mul_ps(six, t), om), _mm256_mul_ps(t3, t));
+    dB[3] = _mm256_mul_ps(t3, t);
+}
+
+BEZIER_TARGET_AVX2 inline __m256 bezierDot4AVX2(__m256 a0, __m256 a1, __m256 a2, __m256 a3, const __m256 w[4]) {
+    __m256 s = _mm256_add_ps(_mm256_mul_ps(a0, w[0]), _mm256_mul_ps(a1, w[1]));
+    s = _mm256_add_ps(s, _mm256_mul_ps(a2, w[2]));
+    return _mm256_add_ps(s, _mm256_mul_ps(a3, w[3]));
+}
+
+BEZIER_TARGET_AVX2 inline void storeSamplesAVX2(const PatchSamples& out, size_t k, const __m256 P[3],
+                                                const __m256 Pu[3], const __m256 Pv[3]) {
+    _mm256_storeu_ps(out.px + k, P[0]);
+    _mm256_storeu_ps(out.py + k, P[1]);
+    _mm256_storeu_ps(out.pz + k, P[2]);
+    if (!out.nx) return;
+    __m256 nx = _mm256_sub_ps(_mm256_mul_ps(Pu[1], Pv[2]), _mm256_mul_ps(Pu[2], Pv[1]));
+    __m256 ny = _mm256_sub_ps(_mm256_mul_ps(Pu[2], Pv[0]), _mm256_mul_ps(Pu[0], Pv[2]));
+    __m256 nz = _mm256_sub_ps(_mm256_mul_ps(Pu[0], Pv[1]), _mm256_mul_ps(Pu[1], Pv[0]));
+    __m256 L = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz)));
+    __m256 ok = _mm256_cmp_ps(L, _mm256_set1_ps(1e-6f), _CMP_GT_OQ);
+    nx = _mm256_blendv_ps(nx, _mm256_div_ps(nx, L), ok);
+    ny = _mm256_blendv_ps(ny, _mm256_div_ps(ny, L), ok);
+    nz = _mm256_blendv_ps(nz, _mm256_div_ps(nz, L), ok);
+    _mm256_storeu_ps(out.nx + k, nx);
+    _mm256_storeu_ps(out.ny + k, ny);
+    _mm256_storeu_ps(out.nz + k, nz);
+}
+
+BEZIER_TARGET_AVX2 inline void evalPatchAVX2(const PatchSoA& p, const float* u, const float* v,
+                                             size_t begin, size_t end, const PatchSamples& out) {
+    const float* cp[3] = { p.x, p.y, p.z };
+    size_t k = begin;
+    for (; k + 8 <= end; k += 8) {
+        __m256 Bu[4], dBu[4], Bv[4], dBv[4];
+        bezierBasisAVX2(_mm256_loadu_ps(u + k), Bu, dBu);
+        bezierBasisAVX2(_mm256_loadu_ps(v + k), Bv, dBv);
+        __m256 P[3], Pu[3], Pv[3];
+        for (int c = 0; c < 3; c++) {
+            const float* q = cp[c];
+            __m256 C[4], D[4];
+            for (int i = 0; i < 4; i++) {
+                __m256 q0 = _mm256_set1_ps(q[i * 4]), q1 = _mm256_set1_ps(q[i * 4 + 1]);
+                __m256 q2 = _mm256_set1_ps(q[i * 4 + 2]), q3 = _mm256_set1_ps(q[i * 4 + 3]);
+                C[i] = bezierDot4AVX2(q0, q1, q2, q3, Bv);
+                D[i] = bezierDot4AVX2(q0, q1, q2, q3, dBv);
+            }
+            P[c]  = bezierDot4AVX2(C[0], C[1], C[2], C[3], Bu);
+            Pu[c] = bezierDot4AVX2(C[0], C[1], C[2], C[3], dBu);
+            Pv[c] = bezierDot4AVX2(D[0], D[1], D[2], D[3], Bu);
+        }
+        storeSamplesAVX2(out, k, P, Pu, Pv);
+    }
+    // finish the tail 4-wide, then scalar
+    evalPatchSSE(p, u, v, k, end, out);
+}
+
+BEZIER_TARGET_AVX2 inline void evalPatchRowAVX2(const PatchRow& r, const float* u, size_t begin, size_t end,
+                                                const PatchSamples& out) {
+    __m256 C[3][4], D[3][4];
+    for (int c = 0; c < 3; c++)
+        for (int i = 0; i < 4; i++) {
+            C[c][i] = _mm256_set1_ps(r.C[c][i]);
+            D[c][i] = _mm256_set1_ps(r.D[c][i]);
+        }
+    size_t k = begin;
+    for (; k + 8 <= end; k += 8) {
+        __m256 Bu[4], dBu[4];
+        bezierBasisAVX2(_mm256_loadu_ps(u + k), Bu, dBu);
+        __m256 P[3], Pu[3], Pv[3];
+        for (int c = 0; c < 3; c++) {
+            P[c]  = bezierDot4AVX2(C[c][0], C[c][1], C[c][2], C[c][3], Bu);
+            Pu[c] = bezierDot4AVX2(C[c][0], C[c][1], C[c][2], C[c][3], dBu);
+            Pv[c] = bezierDot4AVX2(D[c][0], D[c][1], D[c][2], D[c][3], Bu);
+        }
+        storeSamplesAVX2(out, k, P, Pu, Pv);
+    }
+    evalPatchRowSSE(r, u, k, end, out);
+}
+
+#endif // BEZIER_SIMD_X86
+
+// ---- dispatch ----------------------------------------------------------------
+
+inline SimdLevel bezierSimdLevel() {
+    static const SimdLevel level = detectSimdLevel();
+    return level;
+}
+
+// Evaluates n samples (u[k], v[k]) of patch p into out[k] with the best
+// available instruction set, or with `force` when it is not SIMD_AVX2 (useful
+// to compare paths).
+inline void evalPatchBatch(const PatchSoA& p, const float* u, const float* v, size_t n,
+                           const PatchSamples& out, SimdLevel force = SIMD_AVX2) {
+    SimdLevel l = bezierSimdLevel();
+    if (force < l) l = force;
+#ifdef BEZIER_SIMD_X86
+    if (l == SIMD_AVX2) { evalPatchAVX2(p, u, v, 0, n, out); return; }
+    if (l == SIMD_SSE)  { evalPatchSSE(p, u, v, 0, n, out); return; }
+#endif
+    evalPatchScalar(p, u, v, 0, n, out);
+}
+
+// Evaluates n samples (u[k], v) of patch p, all at the same v, into out[k]
+inline void evalPatchRow(const PatchSoA& p, const float* u, float v, size_t n, const PatchSamples& out,
+                         SimdLevel force = SIMD_AVX2) {
+    SimdLevel l = bezierSimdLevel();
+    if (force < l) l = force;
+    PatchRow r = collapsePatchRow(p, v);
+#ifdef BEZIER_SIMD_X86
+    if (l == SIMD_AVX2) { evalPatchRowAVX2(r, u, 0, n, out); return; }
+    if (l == SIMD_SSE)  { evalPatchRowSSE(r, u, 0, n, out); return; }
+#endif
+    evalPatchRowScalar(r, u, 0, n, out);
+}
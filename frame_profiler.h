@@ -0,0 +1,316 @@
+// frame_profiler.h
+// Scoped CPU/GPU timers for finding where a frame goes. A ProfileScope
+// records the CPU time of its block; with gpu = true it also brackets the
+// block's GL commands with two GL_TIMESTAMP queries. Queries come from a
+// fixed ring per context and are read back only once GL reports them
+// available, so the profiler never waits on the GPU; a scope that finds its
+// ring slot still in flight simply goes without a GPU time.
+//
+// Every scope name gets running statistics over its last 4096 samples
+// (mean, p50, p99 for CPU and GPU). enable() registers an exit handler that
+// prints them and writes a Chrome trace_event JSON file (chrome://tracing or
+// ui.perfetto.dev) with CPU scopes on one track and each context's GPU work
+// on another, GPU timestamps shifted onto the CPU clock.
+//
+// While disabled a scope costs one branch. Scopes must be opened and closed
+// on the thread that owns the GL context. A program rendering with several
+// contexts calls setContext() after each switch, because query objects are
+// not shared between contexts.
+//
+// Include the GL loader (GLEW or glad) before this header; GPU timing needs
+// GL 3.3 or GL_ARB_timer_query.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class FrameProfiler {
+public:
+    FrameProfiler() : start(std::chrono::steady_clock::now()) {}
+
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    // Starts recording; stats and the trace are written when the program exits
+    void enable(const char* tracePath = "trace.json") {
+        if (on) return;
+        on = true;
+        trace = tracePath;
+        std::atexit([] { instance().finish(); });
+    }
+
+    bool enabled() const { return on; }
+
+    // Makes `ctx` (any per-context handle, e.g. the GLFWwindow) the context
+    // GPU scopes use from now on and reads back its finished queries
+    void setContext(const void* ctx) {
+        if (!on) return;
+        auto it = timelineIndex.find(ctx);
+        if (it == timelineIndex.end()) {
+            it = timelineIndex.emplace(ctx, (int)timelines.size()).first;
+            timelines.emplace_back();
+        }
+        current = it->second;
+        collect(timelines[current]);
+    }
+
+    // Call once per frame, after the swap; closes the "frame" sample
+    void endFrame() {
+        if (!on) return;
+        double t = nowUs();
+        if (lastFrame >= 0) addCpu(scopeId("frame"), lastFrame, t - lastFrame);
+        lastFrame = t;
+        if (!timelines.empty()) collect(timelines[current]);
+        frames++;
+    }
+
+    // Used by ProfileScope
+    struct Open { int scope; double begin; int slot; };
+
+    Open begin(const char* name, bool gpu) {
+        Open o = { scopeId(name), nowUs(), -1 };
+        if (gpu) o.slot = gpuBegin(o.scope);
+        return o;
+    }
+
+    void end(const Open& o) {
+        if (o.slot >= 0) gpuEnd(o.slot);
+        addCpu(o.scope, o.begin, nowUs() - o.begin);
+    }
+
+    void printStats(FILE* out) const {
+        fprintf(out, "\n%-18s %7s | %9s %9s %9s | %9s %9s %9s\n", "scope (ms)", "count", "cpu mean", "p50",
+                "p99", "gpu mean", "p50", "p99");
+        for (const Scope& s : scopes) {
+            Summary c = summarize(s.cpu), g = summarize(s.gpu);
+            fprintf(out, "%-18s %7zu | %9.3f %9.3f %9.3f | ", s.name.c_str(), s.count, c.mean, c.p50, c.p99);
+            if (s.gpu.empty()) fprintf(out, "%9s %9s %9s\n", "-", "-", "-");
+            else fprintf(out, "%9.3f %9.3f %9.3f\n", g.mean, g.p50, g.p99);
+        }
+        fprintf(out, "%zu frames", frames);
+        if (droppedGpu) fprintf(out, ", %zu GPU samples skipped (query ring busy)", droppedGpu);
+        if (events.size() >= MAX_EVENTS) fprintf(out, ", trace truncated at %zu events", MAX_EVENTS);
+        fprintf(out, "\n");
+    }
+
+    bool writeTrace(const char* path) const {
+        FILE* f = fopen(path, "w");
+        if (!f) return false;
+        fprintf(f, "{\"traceEvents\":[\n");
+        fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"CPU\"}}");
+        for (size_t k = 0; k < timelines.size(); k++)
+            fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"GPU %zu\"}}",
+                    k + 1, k);
+        for (const Event& e : events)
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    scopes[e.scope].name.c_str(), e.tid ? "gpu" : "cpu", e.tid, e.ts, e.dur);
+        fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        return fclose(f) == 0;
+    }
+
+    static FrameProfiler& instance() {
+        static FrameProfiler p;
+        return p;
+    }
+
+private:
+    static constexpr size_t SAMPLES = 4096;      // per scope, for the statistics
+    static constexpr size_t MAX_EVENTS = 1 << 20; // trace events kept
+    static constexpr int RING = 128;             // timestamp pairs per context
+
+    struct Scope {
+        std::string name;
+        std::vector<double> cpu, gpu; // ms, rings of SAMPLES
+        size_t count = 0, gpuCount = 0;
+    };
+    struct Event { int scope, tid; double ts, dur; }; // microseconds
+    struct GpuSlot { unsigned int q[2]; int scope; bool pending; };
+    struct Timeline {
+        bool ready = false, supported = false;
+        std::vector<GpuSlot> ring;
+        int next = 0;
+        double offsetUs = 0; // CPU time minus GPU time
+    };
+    struct Summary { double mean, p50, p99; };
+
+    bool on = false;
+    std::string trace;
+    std::chrono::steady_clock::time_point start;
+    std::vector<Scope> scopes;
+    std::unordered_map<std::string, int> scopeIndex;
+    std::vector<Event> events;
+    std::map<const void*, int> timelineIndex;
+    std::vector<Timeline> timelines;
+    int current = 0;
+    double lastFrame = -1;
+    size_t frames = 0, droppedGpu = 0;
+
+    double nowUs() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    int scopeId(const char* name) {
+        auto it = scopeIndex.find(name);
+        if (it != scopeIndex.end()) return it->second;
+        int id = (int)scopes.size();
+        scopes.emplace_back();
+        scopes.back().name = name;
+        scopeIndex.emplace(name, id);
+        return id;
+    }
+
+    static void addSample(std::vector<double>& ring, size_t& count, double v) {
+        if (ring.size() < SAMPLES) ring.push_back(v);
+        else ring[count % SAMPLES] = v;
+        count++;
+    }
+
+    void addCpu(int scope, double beginUs, double durUs) {
+        addSample(scopes[scope].cpu, scopes[scope].count, durUs / 1000.0);
+        if (events.size() < MAX_EVENTS) events.push_back({ scope, 0, beginUs, durUs });
+    }
+
+    static Summary summarize(std::vector<double> v) {
+        Summary s = { 0, 0, 0 };
+        if (v.empty()) return s;
+        for (double x : v) s.mean += x;
+        s.mean /= v.size();
+        std::sort(v.begin(), v.end());
+        s.p50 = v[(v.size() - 1) / 2];
+        s.p99 = v[std::min(v.size() - 1, (size_t)(v.size() * 0.99))];
+        return s;
+    }
+
+    static bool timerQuerySupported() {
+#ifdef GL_TIMESTAMP
+        const char* v = (const char*)glGetString(GL_VERSION);
+        int major = 0, minor = 0;
+        if (v && sscanf(v, "%d.%d", &major, &minor) == 2 && (major > 3 || (major == 3 && minor >= 3)))
+            return true;
+        if (major >= 3) {
+            GLint n = 0;
+            glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+            for (GLint i = 0; i < n; i++) {
+                const char* e = (const char*)glGetStringi(GL_EXTENSIONS, i);
+                if (e && strcmp(e, "GL_ARB_timer_query") == 0) return true;
+            }
+        }
+#endif
+        return false;
+    }
+
+    Timeline& timeline() {
+        if (timelines.empty()) setContext(nullptr);
+        Timeline& t = timelines[current];
+        if (!t.ready) {
+            t.ready = true;
+            t.supported = timerQuerySupported();
+#ifdef GL_TIMESTAMP
+            if (t.supported) {
+                t.ring.resize(RING);
+                for (GpuSlot& s : t.ring) {
+                    glGenQueries(2, s.q);
+                    s.pending = false;
+                }
+                GLint64 gpuNs = 0;
+                glGetInteger64v(GL_TIMESTAMP, &gpuNs);
+                t.offsetUs = nowUs() - gpuNs / 1000.0;
+            }
+#endif
+        }
+        return t;
+    }
+
+    // Turns a finished query pair into a GPU sample; false if still in flight
+    bool readSlot(Timeline& t, GpuSlot& s) {
+#ifdef GL_TIMESTAMP
+        GLint available = 0;
+        glGetQueryObjectiv(s.q[1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+        GLuint64 t0 = 0, t1 = 0;
+        glGetQueryObjectui64v(s.q[0], GL_QUERY_RESULT, &t0);
+        glGetQueryObjectui64v(s.q[1], GL_QUERY_RESULT, &t1);
+        s.pending = false;
+        double durUs = (t1 - t0) / 1000.0;
+        Scope& sc = scopes[s.scope];
+        addSample(sc.gpu, sc.gpuCount, durUs / 1000.0);
+        int tid = (int)(&t - timelines.data()) + 1;
+        if (events.size() < MAX_EVENTS) events.push_back({ s.scope, tid, t0 / 1000.0 + t.offsetUs, durUs });
+        return true;
+#else
+        (void)t; (void)s;
+        return false;
+#endif
+    }
+
+    // Reads every finished pair, oldest first, without blocking
+    void collect(Timeline& t) {
+        if (!t.ready || !t.supported) return;
+        for (int k = 0; k < RING; k++) {
+            GpuSlot& s = t.ring[(t.next + k) % RING];
+            if (s.pending && !readSlot(t, s)) break;
+        }
+    }
+
+    int gpuBegin(int scope) {
+        Timeline& t = timeline();
+        if (!t.supported) return -1;
+        GpuSlot& s = t.ring[t.next];
+        if (s.pending && !readSlot(t, s)) {
+            droppedGpu++;
+            return -1;
+        }
+#ifdef GL_TIMESTAMP
+        glQueryCounter(s.q[0], GL_TIMESTAMP);
+#endif
+        s.scope = scope;
+        int slot = t.next;
+        t.next = (t.next + 1) % RING;
+        return slot;
+    }
+
+    void gpuEnd(int slot) {
+        GpuSlot& s = timelines[current].ring[slot];
+#ifdef GL_TIMESTAMP
+        glQueryCounter(s.q[1], GL_TIMESTAMP);
+#endif
+        s.pending = true;
+    }
+
+    void finish() {
+        if (!on) return;
+        printStats(stderr);
+        if (writeTrace(trace.c_str())) fprintf(stderr, "Trace written to %s\n", trace.c_str());
+        else fprintf(stderr, "Could not write trace %s\n", trace.c_str());
+        on = false;
+    }
+};
+
+inline FrameProfiler& frameProfiler() { return FrameProfiler::instance(); }
+
+// Times the enclosing block under `name`; gpu = true also times its GL
+// commands. A GPU scope must not span a setContext() call.
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name, bool gpu = false) : active(frameProfiler().enabled()) {
+        if (active) open = frameProfiler().begin(name, gpu);
+    }
+    ~ProfileScope() {
+        if (active) frameProfiler().end(open);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    bool active;
+    FrameProfiler::Open open;
+};
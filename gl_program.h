@@ -0,0 +1,232 @@
+// gl_program.h
+// Shader program shared by every GL program here. build() compiles and links
+// the stages, then reflects the active uniforms and uniform blocks once into
+// name -> location tables. Callers look up what they need right after
+// linking and keep the GLint, so a draw loop never asks GL about a name.
+//
+// UniformBlock<T> is a uniform buffer holding one std140 struct T at a fixed
+// binding point. update() re-uploads it only when the contents changed, so
+// per-frame camera/material data costs at most one glBufferSubData per block.
+// Uniform blocks need GL 3.1; on older contexts only plain uniforms are
+// reflected.
+//
+// Both are usually globals that outlive the GL context, so their GL objects
+// are freed by destroy() rather than by the destructor.
+//
+// Linked programs go through the binary cache in program_cache.h when the
+// driver supports it; the source path is the fallback.
+//
+// Include the GL loader (GLEW or glad) before this header.
+
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "program_cache.h"
+
+struct ShaderStage {
+    GLenum type;
+    const char* src;
+};
+
+class GLProgram {
+public:
+    GLProgram() {}
+
+    GLProgram(const GLProgram&) = delete;
+    GLProgram& operator=(const GLProgram&) = delete;
+
+    // Loads the cached binary or compiles every stage and links them; errors
+    // go to std::cerr with the info log and leave the program invalid
+    bool build(std::initializer_list<ShaderStage> stages) {
+        destroy();
+        bool cached = programCacheEnabled && programBinarySupported();
+        uint64_t key = 0;
+        if (cached) {
+            std::string all;
+            for (const ShaderStage& s : stages) {
+                all += std::to_string(s.type) + '\n';
+                all.append(s.src, strlen(s.src) + 1);
+            }
+            key = programCacheKey(all);
+            prog = glCreateProgram();
+            if (loadProgramBinary(key, prog)) {
+                fromCache = true;
+                reflect();
+                return true;
+            }
+            glDeleteProgram(prog);
+            prog = 0;
+        }
+
+        std::vector<GLuint> shaders;
+        bool ok = true;
+        for (const ShaderStage& s : stages) {
+            GLuint sh = compile(s.type, s.src);
+            if (!sh) ok = false;
+            else shaders.push_back(sh);
+        }
+        if (ok) {
+            prog = glCreateProgram();
+            for (GLuint sh : shaders) glAttachShader(prog, sh);
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+            if (cached) glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
+            glLinkProgram(prog);
+            GLint linked = 0;
+            glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+            if (!linked) {
+                std::cerr << "Program link error:\n" << infoLog(prog, false) << std::endl;
+                glDeleteProgram(prog);
+                prog = 0;
+                ok = false;
+            }
+        }
+        for (GLuint sh : shaders) glDeleteShader(sh);
+        if (ok) reflect();
+        if (ok && cached) saveProgramBinary(key, prog);
+        return ok;
+    }
+
+    bool valid() const { return prog != 0; }
+    bool loadedFromCache() const { return fromCache; }
+    GLuint id() const { return prog; }
+    void use() const { glUseProgram(prog); }
+
+    // Location of an active uniform ("name" or "name[0]" for arrays), -1 if
+    // the linker dropped it; glUniform* ignores -1
+    GLint uniform(const char* name) const {
+        auto it = uniforms.find(name);
+        return it == uniforms.end() ? -1 : it->second;
+    }
+
+    // Points a uniform block at a binding point; false if it is not active
+    bool bindBlock(const char* name, GLuint binding) const {
+        auto it = blocks.find(name);
+        if (it == blocks.end()) return false;
+        glUniformBlockBinding(prog, it->second, binding);
+        return true;
+    }
+
+    void destroy() {
+        if (prog) glDeleteProgram(prog);
+        prog = 0;
+        fromCache = false;
+        uniforms.clear();
+        blocks.clear();
+    }
+
+private:
+    GLuint prog = 0;
+    bool fromCache = false;
+    std::unordered_map<std::string, GLint> uniforms;
+    std::unordered_map<std::string, GLuint> blocks;
+
+    static std::string infoLog(GLuint obj, bool shader) {
+        GLint len = 0;
+        if (shader) glGetShaderiv(obj, GL_INFO_LOG_LENGTH, &len);
+        else glGetProgramiv(obj, GL_INFO_LOG_LENGTH, &len);
+        std::string log(len > 1 ? len : 1, '\0');
+        if (shader) glGetShaderInfoLog(obj, (GLsizei)log.size(), nullptr, &log[0]);
+        else glGetProgramInfoLog(obj, (GLsizei)log.size(), nullptr, &log[0]);
+        log.resize(strlen(log.c_str()));
+        return log;
+    }
+
+    static GLuint compile(GLenum type, const char* src) {
+        GLuint sh = glCreateShader(type);
+        glShaderSource(sh, 1, &src, nullptr);
+        glCompileShader(sh);
+        GLint ok = 0;
+        glGetShaderiv(sh, GL_COMPILE_STATUS, &ok);
+        if (!ok) {
+            std::cerr << "Shader compile error:\n" << infoLog(sh, true) << std::endl;
+            std::cerr << "Shader source:\n" << src << std::endl;
+            glDeleteShader(sh);
+            return 0;
+        }
+        return sh;
+    }
+
+    static bool hasUniformBlocks() {
+        const char* v = (const char*)glGetString(GL_VERSION);
+        int major = 0, minor = 0;
+        if (!v || sscanf(v, "%d.%d", &major, &minor) != 2) return false;
+        return major > 3 || (major == 3 && minor >= 1);
+    }
+
+    void reflect() {
+        GLint count = 0, maxLen = 0;
+        glGetProgramiv(prog, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(prog, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLen);
+        std::vector<char> name(maxLen > 0 ? maxLen : 1);
+        for (GLint i = 0; i < count; i++) {
+            GLint size;
+            GLenum type;
+            glGetActiveUniform(prog, (GLuint)i, (GLsizei)name.size(), nullptr, &size, &type, name.data());
+            GLint loc = glGetUniformLocation(prog, name.data());
+            if (loc < 0) continue; // member of a uniform block
+            std::string n = name.data();
+            uniforms[n] = loc;
+            size_t bracket = n.rfind("[0]");
+            if (bracket != std::string::npos && bracket + 3 == n.size()) uniforms[n.substr(0, bracket)] = loc;
+        }
+        if (!hasUniformBlocks()) return;
+        glGetProgramiv(prog, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(prog, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLen);
+        name.assign(maxLen > 0 ? maxLen : 1, '\0');
+        for (GLint i = 0; i < count; i++) {
+            glGetActiveUniformBlockName(prog, (GLuint)i, (GLsizei)name.size(), nullptr, name.data());
+            blocks[name.data()] = (GLuint)i;
+        }
+    }
+};
+
+// One std140 struct in a uniform buffer bound to `binding`. T must mirror the
+// GLSL block: vec3/vec4 and mat columns start on 16 bytes, a mat3 is three
+// padded vec4 columns.
+template <class T>
+class UniformBlock {
+public:
+    UniformBlock() {}
+
+    UniformBlock(const UniformBlock&) = delete;
+    UniformBlock& operator=(const UniformBlock&) = delete;
+
+    void create(GLuint bindingPoint) {
+        binding = bindingPoint;
+        if (!buf) glGenBuffers(1, &buf);
+        glBindBuffer(GL_UNIFORM_BUFFER, buf);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buf);
+        uploaded = false;
+    }
+
+    GLuint id() const { return buf; }
+
+    // Uploads `v` unless it equals what the buffer already holds
+    void update(const T& v) {
+        if (uploaded && memcmp(&v, &last, sizeof(T)) == 0) return;
+        glBindBuffer(GL_UNIFORM_BUFFER, buf);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &v);
+        last = v;
+        uploaded = true;
+    }
+
+    void destroy() {
+        if (buf) glDeleteBuffers(1, &buf);
+        buf = 0;
+        uploaded = false;
+    }
+
+private:
+    GLuint buf = 0, binding = 0;
+    T last;
+    bool uploaded = false;
+};
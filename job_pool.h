@@ -0,0 +1,144 @@
+// job_pool.h
+// Small work-stealing thread pool used to tessellate patch grids in parallel.
+// Each worker owns a deque: it pops its own jobs from the back and steals from
+// the front of the others when it runs dry. The thread calling parallelFor
+// takes part as well, so a pool of N workers runs on N + 1 threads.
+//
+// Jobs only receive an index range; callers write their results into
+// preallocated slices indexed by that range, which keeps the output identical
+// regardless of the thread count or the order jobs happen to run in.
+//
+// Header-only; link with -pthread on Linux.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobPool {
+public:
+    typedef std::function<void(int, int)> RangeFn;
+
+    // workers < 0 picks hardware_concurrency() - 1; 0 runs everything inline
+    explicit JobPool(int workers = -1) {
+        if (workers < 0) workers = std::max(0, (int)std::thread::hardware_concurrency() - 1);
+        for (int i = 0; i <= workers; i++) queues.emplace_back(new Queue);
+        for (int i = 0; i < workers; i++) threads.emplace_back(&JobPool::workerLoop, this, i);
+    }
+
+    ~JobPool() {
+        {
+            std::lock_guard<std::mutex> lk(sleepM);
+            quit = true;
+        }
+        sleepCv.notify_all();
+        for (auto& t : threads) t.join();
+    }
+
+    JobPool(const JobPool&) = delete;
+    JobPool& operator=(const JobPool&) = delete;
+
+    // total threads that run jobs (workers + caller)
+    int threadCount() const { return (int)threads.size() + 1; }
+
+    // Calls fn(b, e) over [begin, end) split into chunks of at most `grain`
+    // items and returns once every chunk has finished.
+    void parallelFor(int begin, int end, int grain, const RangeFn& fn) {
+        if (end <= begin) return;
+        grain = std::max(1, grain);
+        int chunks = (end - begin + grain - 1) / grain;
+        if (threads.empty() || chunks == 1) { fn(begin, end); return; }
+
+        std::atomic<int> pending(chunks);
+        int nq = (int)queues.size();
+        for (int c = 0; c < chunks; c++) {
+            int b = begin + c * grain;
+            Job job = { &fn, b, std::min(end, b + grain), &pending };
+            Queue& q = *queues[c % nq];
+            std::lock_guard<std::mutex> lk(q.m);
+            q.jobs.push_back(job);
+        }
+        {
+            std::lock_guard<std::mutex> lk(sleepM);
+            queued += chunks;
+        }
+        sleepCv.notify_all();
+
+        // help out until our jobs are gone, then wait for the stragglers
+        int self = nq - 1;
+        Job job;
+        while (pending.load() > 0 && take(self, job)) run(job);
+        std::unique_lock<std::mutex> lk(doneM);
+        doneCv.wait(lk, [&] { return pending.load() == 0; });
+    }
+
+    // Picks a chunk size giving each thread a few chunks to balance with
+    int grainFor(int count) const {
+        return std::max(1, count / (threadCount() * 4));
+    }
+
+private:
+    struct Job {
+        const RangeFn* fn;
+        int begin, end;
+        std::atomic<int>* pending;
+    };
+    struct Queue {
+        std::mutex m;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker, last is the caller's
+    std::vector<std::thread> threads;
+    std::mutex sleepM, doneM;
+    std::condition_variable sleepCv, doneCv;
+    int queued = 0; // guarded by sleepM
+    bool quit = false;
+
+    // own queue from the back, otherwise steal from the front of another
+    bool take(int self, Job& out) {
+        int nq = (int)queues.size();
+        for (int k = 0; k < nq; k++) {
+            Queue& q = *queues[(self + k) % nq];
+            std::lock_guard<std::mutex> lk(q.m);
+            if (q.jobs.empty()) continue;
+            if (k == 0) { out = q.jobs.back(); q.jobs.pop_back(); }
+            else { out = q.jobs.front(); q.jobs.pop_front(); }
+            std::lock_guard<std::mutex> slk(sleepM);
+            queued--;
+            return true;
+        }
+        return false;
+    }
+
+    void run(const Job& job) {
+        (*job.fn)(job.begin, job.end);
+        if (job.pending->fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lk(doneM);
+            doneCv.notify_all();
+        }
+    }
+
+    void workerLoop(int self) {
+        for (;;) {
+            Job job;
+            if (take(self, job)) { run(job); continue; }
+            std::unique_lock<std::mutex> lk(sleepM);
+            sleepCv.wait(lk, [&] { return quit || queued > 0; });
+            if (quit && queued == 0) return;
+        }
+    }
+};
+
+// Process-wide pool shared by the tessellators
+inline JobPool& jobPool() {
+    static JobPool pool;
+    return pool;
+}
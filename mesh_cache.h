@@ -0,0 +1,176 @@
+// mesh_cache.h
+// On-disk cache of tessellated meshes. A cache file is a fixed header followed
+// by the raw vertex array and the 32-bit index array, both 16-byte aligned, so
+// a mapped file can be handed straight to glBufferData with no parsing.
+//
+// Files are named after a 64-bit FNV-1a key over the control points, the
+// resolution and the vertex layout tag, and live in mesh_cache/ next to the
+// working directory. A header that does not match the key, layout or file
+// size is treated as a miss and the file is rewritten.
+//
+// Header-only; uses mmap on POSIX and MapViewOfFile on Windows.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Vertex layout tags; a program picks one per vertex struct it caches
+inline constexpr uint32_t meshLayoutTag(char a, char b, char c, char d) {
+    return (uint32_t)(unsigned char)a | (uint32_t)(unsigned char)b << 8 |
+           (uint32_t)(unsigned char)c << 16 | (uint32_t)(unsigned char)d << 24;
+}
+
+const uint32_t MESH_CACHE_MAGIC = meshLayoutTag('B', 'Z', 'M', 'C');
+const uint32_t MESH_CACHE_VERSION = 2; // bump when the tessellation output changes
+
+struct MeshCacheHeader {
+    uint32_t magic, version, layout, vertexStride;
+    uint64_t key;
+    uint64_t vertexCount, indexCount;
+    uint64_t vertexOffset, indexOffset; // bytes from the start of the file
+};
+
+inline uint64_t fnv1a(const void* data, size_t n, uint64_t h = 14695981039346656037ull) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t k = 0; k < n; k++) { h ^= p[k]; h *= 1099511628211ull; }
+    return h;
+}
+
+// Key of a mesh: control points (any count of floats), resolution, layout
+inline uint64_t meshCacheKey(const float* ctrl, size_t floatCount, int res, uint32_t layout) {
+    uint64_t h = fnv1a(ctrl, floatCount * sizeof(float));
+    h = fnv1a(&res, sizeof(res), h);
+    h = fnv1a(&layout, sizeof(layout), h);
+    return fnv1a(&MESH_CACHE_VERSION, sizeof(MESH_CACHE_VERSION), h);
+}
+
+inline std::string meshCachePath(uint64_t key) {
+    char name[40];
+    snprintf(name, sizeof(name), "%016llx.mesh", (unsigned long long)key);
+    return (std::filesystem::path("mesh_cache") / name).string();
+}
+
+// Read-only mapping of one cache file; empty when the file is missing or
+// does not match the expected key and layout
+class MappedMesh {
+public:
+    MappedMesh() {}
+    MappedMesh(const MappedMesh&) = delete;
+    MappedMesh& operator=(const MappedMesh&) = delete;
+    ~MappedMesh() { close(); }
+
+    bool open(const std::string& path, uint64_t key, uint32_t layout, uint32_t vertexStride) {
+        close();
+        if (!map(path)) return false;
+        const MeshCacheHeader* h = header();
+        bool ok = size >= sizeof(MeshCacheHeader) && h->magic == MESH_CACHE_MAGIC &&
+                  h->version == MESH_CACHE_VERSION && h->key == key && h->layout == layout &&
+                  h->vertexStride == vertexStride &&
+                  h->vertexOffset + h->vertexCount * vertexStride <= size &&
+                  h->indexOffset + h->indexCount * sizeof(uint32_t) <= size;
+        if (!ok) close();
+        return ok;
+    }
+
+    bool valid() const { return base != nullptr; }
+    const MeshCacheHeader* header() const { return (const MeshCacheHeader*)base; }
+    const void* vertices() const { return (const char*)base + header()->vertexOffset; }
+    const uint32_t* indices() const { return (const uint32_t*)((const char*)base + header()->indexOffset); }
+    size_t vertexBytes() const { return (size_t)(header()->vertexCount * header()->vertexStride); }
+    size_t indexCount() const { return (size_t)header()->indexCount; }
+
+    void close() {
+        if (!base) return;
+#ifdef _WIN32
+        UnmapViewOfFile(base);
+#else
+        munmap(base, size);
+#endif
+        base = nullptr;
+        size = 0;
+    }
+
+private:
+    void* base = nullptr;
+    size_t size = 0;
+
+    bool map(const std::string& path) {
+#ifdef _WIN32
+        HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (f == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER sz;
+        HANDLE m = nullptr;
+        if (GetFileSizeEx(f, &sz) && sz.QuadPart > 0)
+            m = CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(f);
+        if (!m) return false;
+        base = MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(m);
+        size = base ? (size_t)sz.QuadPart : 0;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) { base = p; size = (size_t)st.st_size; }
+        }
+        ::close(fd);
+#endif
+        return base != nullptr;
+    }
+};
+
+// Writes a cache file through a temporary name and renames it into place, so
+// a concurrent reader never maps a half-written file
+inline bool writeMeshCache(const std::string& path, uint64_t key, uint32_t layout, uint32_t vertexStride,
+                           const void* verts, size_t vertexCount, const uint32_t* inds, size_t indexCount) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+    MeshCacheHeader h = {};
+    h.magic = MESH_CACHE_MAGIC;
+    h.version = MESH_CACHE_VERSION;
+    h.layout = layout;
+    h.vertexStride = vertexStride;
+    h.key = key;
+    h.vertexCount = vertexCount;
+    h.indexCount = indexCount;
+    h.vertexOffset = (sizeof(h) + 15) & ~(uint64_t)15;
+    h.indexOffset = (h.vertexOffset + vertexCount * vertexStride + 15) & ~(uint64_t)15;
+
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    static const char pad[16] = {};
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+              fwrite(pad, 1, h.vertexOffset - sizeof(h), f) == h.vertexOffset - sizeof(h) &&
+              fwrite(verts, vertexStride, vertexCount, f) == vertexCount &&
+              fwrite(pad, 1, h.indexOffset - h.vertexOffset - vertexCount * vertexStride, f) ==
+                  h.indexOffset - h.vertexOffset - vertexCount * vertexStride &&
+              fwrite(inds, sizeof(uint32_t), indexCount, f) == indexCount;
+    ok = fclose(f) == 0 && ok;
+    if (ok) {
+        std::filesystem::rename(tmp, path, ec);
+        ok = !ec;
+    }
+    if (!ok) std::filesystem::remove(tmp, ec);
+    return ok;
+}
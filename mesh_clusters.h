@@ -0,0 +1,198 @@
+// mesh_clusters.h
+// Cluster culling for indexed triangle lists. clusterTriangles() reorders a
+// list so every run of N triangles is spatially compact (Morton order of the
+// triangle centroids, see below) and gives each run a bounding sphere and a
+// normal cone.
+// cullClusters() then keeps the runs that touch the view frustum and are not
+// entirely back-facing, merged into as few (count, offset) ranges as possible
+// for one glMultiDrawElements call. Only the order of the triangles changes,
+// so a clustered list draws the same image as the original one.
+//
+// Everything is in the mesh's own (model) space: the frustum comes from the
+// full proj * view * model matrix and the eye is given in model space.
+//
+// The cone test is the conservative one from meshoptimizer: with all face
+// normals within angle a of the axis, the cluster is back-facing when
+// dot(center - eye, axis) >= sin(a) * |center - eye| + radius. Clusters whose
+// normals spread beyond ~84 degrees never fail it.
+//
+// Needs vec_math.h; no GL calls.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "vec_math.h"
+
+struct MeshCluster {
+    Vec3 center;
+    float radius;
+    Vec3 axis;
+    float cutoff; // sin of the cone's half angle; 1 disables the cone test
+    unsigned int firstIndex, indexCount;
+};
+
+// Six planes (a, b, c, d), a point p inside when a*p.x + b*p.y + c*p.z + d >= 0,
+// normalised so that the value is a distance
+struct Frustum {
+    float plane[6][4];
+};
+
+// Gribb/Hartmann: the planes are sums and differences of the clip matrix rows
+inline Frustum frustumFromMatrix(const Mat4& clip) {
+    Frustum f;
+    for (int p = 0; p < 6; p++) {
+        int row = p / 2;
+        float sign = (p & 1) ? -1.0f : 1.0f;
+        float len = 0.0f;
+        for (int c = 0; c < 4; c++) {
+            f.plane[p][c] = clip.m[c * 4 + 3] + sign * clip.m[c * 4 + row];
+            if (c < 3) len += f.plane[p][c] * f.plane[p][c];
+        }
+        len = len > 0.0f ? 1.0f / sqrtf(len) : 0.0f;
+        for (int c = 0; c < 4; c++) f.plane[p][c] *= len;
+    }
+    return f;
+}
+
+// Bits of x (9 used) spread three apart, for a 27-bit Morton code
+inline uint32_t mortonSpread9(uint32_t x) {
+    x &= 0x1ff;
+    x = (x | x << 16) & 0x30000ff;
+    x = (x | x << 8) & 0x300f00f;
+    x = (x | x << 4) & 0x30c30c3;
+    x = (x | x << 2) & 0x9249249;
+    return x;
+}
+
+// pos holds a position every `stride` floats. morphPos (same stride), when
+// given, is a second position per vertex the mesh may be drawn at (LOD
+// geomorph targets): the spheres then hold both shapes and every blend of
+// them, and the cones the faces of both shapes.
+//
+// Triangles are sorted by the axis their normal points along most (one of
+// six) and then by Morton code, so a cluster rarely mixes faces that look in
+// different directions and its cone stays narrow.
+inline void clusterTriangles(const float* pos, size_t stride, std::vector<unsigned int>& inds,
+                             unsigned int trisPerCluster, std::vector<MeshCluster>& out,
+                             const float* morphPos = nullptr) {
+    out.clear();
+    size_t triCount = inds.size() / 3;
+    if (triCount == 0) return;
+    auto P = [&](const float* base, unsigned int v) {
+        return Vec3(base[v * stride], base[v * stride + 1], base[v * stride + 2]);
+    };
+
+    std::vector<Vec3> centroid(triCount), normal(triCount);
+    Vec3 lo(1e30f, 1e30f, 1e30f), hi(-1e30f, -1e30f, -1e30f);
+    for (size_t t = 0; t < triCount; t++) {
+        Vec3 a = P(pos, inds[3 * t]), b = P(pos, inds[3 * t + 1]), c = P(pos, inds[3 * t + 2]);
+        Vec3 m = (a + b + c) * (1.0f / 3.0f);
+        centroid[t] = m;
+        normal[t] = crossp(b - a, c - a);
+        lo = Vec3(std::min(lo.x, m.x), std::min(lo.y, m.y), std::min(lo.z, m.z));
+        hi = Vec3(std::max(hi.x, m.x), std::max(hi.y, m.y), std::max(hi.z, m.z));
+    }
+    Vec3 ext = hi - lo;
+    float scale = 511.0f / std::max(1e-12f, std::max(ext.x, std::max(ext.y, ext.z)));
+    // (direction bucket, Morton code) << 32 | triangle; only the 30 key bits
+    // need sorting, three 10-bit radix passes
+    std::vector<uint64_t> order(triCount), scratch(triCount);
+    for (size_t t = 0; t < triCount; t++) {
+        const Vec3& n = normal[t];
+        float ax = fabsf(n.x), ay = fabsf(n.y), az = fabsf(n.z);
+        uint32_t bucket = ax >= ay && ax >= az ? (n.x < 0) : ay >= az ? 2 + (n.y < 0) : 4 + (n.z < 0);
+        Vec3 q = (centroid[t] - lo) * scale;
+        uint32_t code = bucket << 27 | mortonSpread9((uint32_t)q.x) | mortonSpread9((uint32_t)q.y) << 1 |
+                        mortonSpread9((uint32_t)q.z) << 2;
+        order[t] = (uint64_t)code << 32 | t;
+    }
+    for (int shift = 32; shift < 62; shift += 10) {
+        size_t start[1025] = {};
+        for (uint64_t k : order) start[(k >> shift & 1023) + 1]++;
+        for (int d = 0; d < 1024; d++) start[d + 1] += start[d];
+        for (uint64_t k : order) scratch[start[k >> shift & 1023]++] = k;
+        order.swap(scratch);
+    }
+    std::vector<unsigned int> sorted(triCount * 3);
+    std::vector<Vec3> sortedNormal(triCount);
+    for (size_t k = 0; k < triCount; k++) {
+        uint32_t t = (uint32_t)order[k];
+        for (int c = 0; c < 3; c++) sorted[3 * k + c] = inds[3 * t + c];
+        sortedNormal[k] = normal[t];
+    }
+    inds.swap(sorted);
+
+    std::vector<Vec3> normals; // unit face normals of one cluster
+    for (size_t first = 0; first < triCount; first += trisPerCluster) {
+        size_t last = std::min(triCount, first + trisPerCluster);
+        normals.clear();
+        Vec3 blo(1e30f, 1e30f, 1e30f), bhi(-1e30f, -1e30f, -1e30f), sum;
+        for (int shape = 0; shape < (morphPos ? 2 : 1); shape++) {
+            const float* base = shape ? morphPos : pos;
+            for (size_t t = first; t < last; t++) {
+                Vec3 a = P(base, inds[3 * t]), b = P(base, inds[3 * t + 1]), c = P(base, inds[3 * t + 2]);
+                for (const Vec3& v : { a, b, c }) {
+                    blo = Vec3(std::min(blo.x, v.x), std::min(blo.y, v.y), std::min(blo.z, v.z));
+                    bhi = Vec3(std::max(bhi.x, v.x), std::max(bhi.y, v.y), std::max(bhi.z, v.z));
+                }
+                Vec3 n = shape ? crossp(b - a, c - a) : sortedNormal[t];
+                if (dotp(n, n) < 1e-24f) continue; // degenerate: faces nowhere
+                n = normalize(n);
+                normals.push_back(n);
+                sum = sum + n;
+            }
+        }
+        MeshCluster cl;
+        cl.center = (blo + bhi) * 0.5f;
+        float r2 = 0.0f;
+        for (int shape = 0; shape < (morphPos ? 2 : 1); shape++)
+            for (size_t k = first * 3; k < last * 3; k++) {
+                Vec3 d = P(shape ? morphPos : pos, inds[k]) - cl.center;
+                r2 = std::max(r2, dotp(d, d));
+            }
+        cl.radius = sqrtf(r2);
+        cl.axis = normalize(sum, Vec3(0, 0, 1));
+        float minDot = normals.empty() ? -1.0f : 1.0f;
+        for (const Vec3& n : normals) minDot = std::min(minDot, dotp(n, cl.axis));
+        cl.cutoff = minDot > 0.1f ? sqrtf(1.0f - minDot * minDot) : 1.0f;
+        cl.firstIndex = (unsigned int)(first * 3);
+        cl.indexCount = (unsigned int)((last - first) * 3);
+        out.push_back(cl);
+    }
+}
+
+inline bool clusterVisible(const MeshCluster& cl, const Frustum& f, const Vec3& eye, bool backface) {
+    for (int p = 0; p < 6; p++) {
+        const float* q = f.plane[p];
+        if (q[0] * cl.center.x + q[1] * cl.center.y + q[2] * cl.center.z + q[3] < -cl.radius) return false;
+    }
+    if (!backface) return true;
+    Vec3 d = cl.center - eye;
+    return dotp(d, cl.axis) < cl.cutoff * length(d) + cl.radius;
+}
+
+// Fills counts/offsets (byte offsets into a 32-bit index buffer) with the
+// visible clusters, neighbours merged; returns the number of indices kept
+inline size_t cullClusters(const std::vector<MeshCluster>& clusters, const Frustum& f, const Vec3& eye,
+                           bool backface, std::vector<int>& counts, std::vector<const void*>& offsets) {
+    counts.clear();
+    offsets.clear();
+    size_t kept = 0;
+    unsigned int runEnd = ~0u;
+    for (const MeshCluster& cl : clusters) {
+        if (!clusterVisible(cl, f, eye, backface)) continue;
+        if (cl.firstIndex == runEnd) counts.back() += (int)cl.indexCount;
+        else {
+            counts.push_back((int)cl.indexCount);
+            offsets.push_back((const void*)(size_t(cl.firstIndex) * sizeof(unsigned int)));
+        }
+        runEnd = cl.firstIndex + cl.indexCount;
+        kept += cl.indexCount;
+    }
+    return kept;
+}
@@ -0,0 +1,102 @@
+// mesh_library.h
+// Static meshes built once and kept on the GPU. add() takes a ModelMesh
+// (shape_meshes.h, bezier_model.h), reorders its triangles for the
+// post-transform vertex cache (vertex_cache.h), interleaves positions and
+// normals into one VBO, uploads the 32-bit indices to an EBO and keeps the
+// reordered mesh on the CPU for ray picking. It records the ACMR before and
+// after the reordering, which report() prints per mesh.
+//
+// A mesh has no VAO of its own: bind() points attributes of the caller's VAO
+// at it, so the caller can add per-instance attributes next to them.
+//
+// Include the GL loader (GLEW or glad) before this header.
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bezier_model.h"
+#include "vertex_cache.h"
+
+class MeshLibrary {
+public:
+    struct Entry {
+        std::string name;
+        ModelMesh mesh;
+        GLuint vbo = 0, ebo = 0;
+        float acmrBefore = 0.0f, acmrAfter = 0.0f;
+        GLsizei indexCount() const { return (GLsizei)mesh.inds.size(); }
+    };
+
+    MeshLibrary() = default;
+    ~MeshLibrary() { clear(); }
+
+    MeshLibrary(const MeshLibrary&) = delete;
+    MeshLibrary& operator=(const MeshLibrary&) = delete;
+
+    // Optimizes and uploads mesh; returns its index
+    int add(const char* name, ModelMesh mesh) {
+        Entry e;
+        e.name = name;
+        size_t n = mesh.vertexCount();
+        e.acmrBefore = acmr(mesh.inds, n);
+        optimizeVertexCache(mesh.inds, n);
+        e.acmrAfter = acmr(mesh.inds, n);
+
+        std::vector<float> interleaved(n * 6);
+        for (size_t v = 0; v < n; v++)
+            for (int c = 0; c < 3; c++) {
+                interleaved[v * 6 + c] = mesh.pos[v * 3 + c];
+                interleaved[v * 6 + 3 + c] = mesh.nrm[v * 3 + c];
+            }
+        glGenBuffers(1, &e.vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, e.vbo);
+        glBufferData(GL_ARRAY_BUFFER, interleaved.size() * sizeof(float), interleaved.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glGenBuffers(1, &e.ebo);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, e.ebo); // not the VAO's element binding
+        glBufferData(GL_COPY_WRITE_BUFFER, mesh.inds.size() * sizeof(unsigned int), mesh.inds.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        e.mesh = std::move(mesh);
+        entries.push_back(std::move(e));
+        return (int)entries.size() - 1;
+    }
+
+    // Points position and normal attributes of the bound VAO at mesh i and
+    // makes its EBO the VAO's index buffer; leaves GL_ARRAY_BUFFER unbound
+    void bind(int i, GLuint posLoc, GLuint nrmLoc) const {
+        const Entry& e = entries[i];
+        glBindBuffer(GL_ARRAY_BUFFER, e.vbo);
+        glEnableVertexAttribArray(posLoc);
+        glVertexAttribPointer(posLoc, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(nrmLoc);
+        glVertexAttribPointer(nrmLoc, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, e.ebo);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    const Entry& operator[](int i) const { return entries[i]; }
+    int size() const { return (int)entries.size(); }
+
+    // One line per mesh: triangles, vertices and ACMR (16-entry FIFO) before
+    // and after the reordering
+    void report(FILE* out = stdout) const {
+        for (const Entry& e : entries)
+            fprintf(out, "  mesh %-8s %7zu triangles %7zu vertices  ACMR %.3f -> %.3f\n", e.name.c_str(),
+                    e.mesh.inds.size() / 3, e.mesh.vertexCount(), e.acmrBefore, e.acmrAfter);
+    }
+
+    void clear() {
+        for (Entry& e : entries) {
+            glDeleteBuffers(1, &e.vbo);
+            glDeleteBuffers(1, &e.ebo);
+        }
+        entries.clear();
+    }
+
+private:
+    std::vector<Entry> entries;
+};
@@ -0,0 +1,179 @@
+// microbench.h
+// Minimal Google Benchmark look-alike for the CPU kernels, so the repo keeps
+// needing nothing but a compiler. A benchmark is a function taking a State
+// and looping `for (auto _ : state)` over the code under test; MICROBENCH()
+// registers it and .arg() adds parameter values (state.arg()).
+//
+// Each case first runs once, then with growing iteration counts until one
+// run takes at least the minimum time (0.2 s, --min-time=<s> to change), and
+// reports the time per iteration of that run. setItems() adds an items/s
+// column, e.g. vertices produced per second. Work that only prepares the
+// next iteration can be kept out of the time with pause()/resume(), and a
+// case that cannot run here calls skip() instead of looping.
+//
+//   static void benchFoo(microbench::State& state) {
+//       for (auto _ : state) microbench::doNotOptimize(foo(state.arg()));
+//       state.setItems(state.iterations() * state.arg(), "vertices");
+//   }
+//   MICROBENCH(benchFoo).arg(8).arg(64);
+//
+//   int main(int argc, char** argv) { return microbench::runAll(argc, argv); }
+//
+// Arguments: a plain word only runs the cases whose name contains it.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace microbench {
+
+// Keeps the compiler from dropping a result that is otherwise unused
+template <class T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+class State {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    State(int64_t iterations, long argument) : total(iterations), param(argument) {}
+
+    long arg() const { return param; }
+    int64_t iterations() const { return total; }
+
+    void pause() { elapsed += Clock::now() - started; }
+    void resume() { started = Clock::now(); }
+
+    // Items handled over the whole run (all iterations) and what they are
+    void setItems(int64_t n, const char* label = "items") {
+        items = n;
+        itemLabel = label;
+    }
+
+    void skip(const char* why) { skipReason = why; }
+    const char* skipped() const { return skipReason; }
+
+    // What `_` holds. The user-provided destructor is what keeps compilers
+    // from reporting `_` as an unused variable; it compiles to nothing.
+    struct Value {
+        ~Value() {}
+    };
+
+    // Counts iterations for `for (auto _ : state)`; the clock runs from the
+    // first begin() to the end of the loop
+    struct Iterator {
+        State* s;
+        int64_t left;
+        bool operator!=(const Iterator&) const {
+            if (left > 0) return true;
+            s->pause();
+            return false;
+        }
+        void operator++() { left--; }
+        Value operator*() const { return {}; }
+    };
+    Iterator begin() {
+        resume();
+        return { this, total };
+    }
+    Iterator end() { return { this, 0 }; }
+
+    double seconds() const { return std::chrono::duration<double>(elapsed).count(); }
+    int64_t itemCount() const { return items; }
+    const char* label() const { return itemLabel; }
+
+private:
+    int64_t total;
+    long param;
+    Clock::time_point started;
+    Clock::duration elapsed = Clock::duration::zero();
+    int64_t items = 0;
+    const char* itemLabel = "items";
+    const char* skipReason = nullptr;
+};
+
+using Function = void (*)(State&);
+
+class Benchmark {
+public:
+    Benchmark(const char* name, Function fn) : name(name), fn(fn) {}
+
+    Benchmark& arg(long value) {
+        args.push_back(value);
+        return *this;
+    }
+
+    std::string name;
+    Function fn;
+    std::vector<long> args;
+};
+
+inline std::vector<Benchmark*>& registry() {
+    static std::vector<Benchmark*> all;
+    return all;
+}
+
+inline Benchmark& add(const char* name, Function fn) {
+    registry().push_back(new Benchmark(name, fn));
+    return *registry().back();
+}
+
+inline void runCase(const Benchmark& b, const std::string& name, long argument, double minTime) {
+    int64_t n = 1;
+    for (;;) {
+        State s(n, argument);
+        b.fn(s);
+        if (s.skipped()) {
+            printf("%-36s skipped: %s\n", name.c_str(), s.skipped());
+            return;
+        }
+        double t = s.seconds();
+        if (t >= minTime || n >= (int64_t(1) << 40)) {
+            printf("%-36s %14.1f %12lld", name.c_str(), t * 1e9 / n, (long long)n);
+            if (s.itemCount() > 0) printf(" %12.3f M %s/s", s.itemCount() / t / 1e6, s.label());
+            printf("\n");
+            return;
+        }
+        // aim 40% past the minimum, growing at most 10x per step
+        double grow = t > 0 ? minTime * 1.4 / t : 10.0;
+        n = (int64_t)(n * (grow < 10.0 ? grow : 10.0)) + 1;
+    }
+}
+
+inline int runAll(int argc, char** argv) {
+    double minTime = 0.2;
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--min-time=", 11) == 0) minTime = atof(argv[i] + 11);
+        else filters.push_back(argv[i]);
+    }
+    printf("%-36s %14s %12s %14s\n", "benchmark", "ns/op", "iterations", "throughput");
+    for (const Benchmark* b : registry()) {
+        std::vector<long> args = b->args;
+        bool plain = args.empty();
+        if (plain) args.push_back(0);
+        for (long a : args) {
+            std::string name = plain ? b->name : b->name + "/" + std::to_string(a);
+            bool selected = filters.empty();
+            for (const std::string& f : filters) selected = selected || name.find(f) != std::string::npos;
+            if (selected) runCase(*b, name, a, minTime);
+        }
+    }
+    return 0;
+}
+
+} // namespace microbench
+
+#define MICROBENCH(fn) static microbench::Benchmark& microbench_##fn = microbench::add(#fn, fn)
@@ -0,0 +1,125 @@
+// pixel_readback.h
+// Asynchronous glReadPixels through a ring of pixel pack buffers. read()
+// only queues a copy of the block into a free buffer followed by a
+// glFenceSync; poll() maps the buffers whose fences have signalled and hands
+// the bytes to the callback given with the read, oldest first. Neither call
+// waits for the GPU, so a read costs the render thread a few GL calls and its
+// result arrives a frame or so later.
+//
+// When every buffer is still in flight read() returns false and the caller
+// drops or retries the request; the ring never blocks to free one. Without
+// GL 3.2 / GL_ARB_sync there are no fences and a read counts as done at the
+// first poll() after it, which may then wait on the map.
+//
+// Include the GL loader (GLEW or glad) before this header.
+
+#pragma once
+
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <vector>
+
+class PixelReadback {
+public:
+    using Callback = std::function<void(const unsigned char* data)>;
+
+    explicit PixelReadback(int count = 4) : slots(count) {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        fencesOk = major > 3 || (major == 3 && minor >= 2) || hasExtension("GL_ARB_sync");
+    }
+
+    ~PixelReadback() {
+        for (Slot& s : slots) {
+            if (s.sync) glDeleteSync(s.sync);
+            if (s.pbo) glDeleteBuffers(1, &s.pbo);
+        }
+    }
+
+    PixelReadback(const PixelReadback&) = delete;
+    PixelReadback& operator=(const PixelReadback&) = delete;
+
+    // Queues a read of the w x h block at (x, y) of the current read
+    // framebuffer and read buffer; `done` gets the pixels, packed as
+    // GL_PACK_ALIGNMENT says, from a later poll()
+    bool read(int x, int y, int w, int h, GLenum format, GLenum type, size_t bytes, Callback done) {
+        int s = freeSlot();
+        if (s < 0) return false;
+        Slot& slot = slots[s];
+        if (!slot.pbo) glGenBuffers(1, &slot.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+        if (slot.bytes < bytes) {
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+            slot.bytes = bytes;
+        }
+        glReadPixels(x, y, w, h, format, type, (void*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        slot.sync = fencesOk ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : 0;
+        slot.size = bytes;
+        slot.done = std::move(done);
+        inFlight.push_back(s);
+        return true;
+    }
+
+    // Runs the callbacks of the reads that have landed
+    void poll() {
+        while (!inFlight.empty()) {
+            Slot& slot = slots[inFlight.front()];
+            if (slot.sync) {
+                // the flush makes sure a fence still queued in the driver gets submitted
+                GLenum r = glClientWaitSync(slot.sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+                if (r == GL_TIMEOUT_EXPIRED) return;
+                glDeleteSync(slot.sync);
+                slot.sync = 0;
+            }
+            inFlight.pop_front();
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+            const void* p = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+            if (p) {
+                result.assign((const unsigned char*)p, (const unsigned char*)p + slot.size);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            Callback done = std::move(slot.done);
+            slot.done = nullptr;
+            if (p && done) done(result.data());
+        }
+    }
+
+    int pending() const { return (int)inFlight.size(); }
+
+private:
+    struct Slot {
+        GLuint pbo = 0;
+        size_t bytes = 0; // allocated
+        size_t size = 0;  // of the read in flight
+        GLsync sync = 0;
+        Callback done;
+    };
+
+    std::vector<Slot> slots;
+    std::deque<int> inFlight; // slot indices, oldest read first
+    std::vector<unsigned char> result;
+    bool fencesOk = false;
+
+    static bool hasExtension(const char* name) {
+        GLint n = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+        for (GLint i = 0; i < n; i++) {
+            const char* e = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (e && strcmp(e, name) == 0) return true;
+        }
+        return false;
+    }
+
+    int freeSlot() const {
+        for (int s = 0; s < (int)slots.size(); s++) {
+            bool busy = false;
+            for (int f : inFlight) busy = busy || f == s;
+            if (!busy) return s;
+        }
+        return -1;
+    }
+};
@@ -0,0 +1,133 @@
+// program_cache.h
+// On-disk cache of linked GL programs (glGetProgramBinary), so a restart
+// skips compiling and linking GLSL. A program is keyed by a 64-bit FNV-1a
+// hash over its stage sources and the GL_VENDOR / GL_RENDERER / GL_VERSION
+// strings; a different GPU or driver update therefore just misses. Files
+// live in shader_cache/ next to the working directory and are written
+// through a temporary name like mesh_cache.h does. A binary the driver
+// rejects is a miss too: the caller compiles from source and rewrites it.
+//
+// Needs GL 4.1 or GL_ARB_get_program_binary with at least one binary format,
+// and a loader that declares the entry points; otherwise every lookup misses
+// and nothing is written.
+//
+// Include the GL loader (GLEW or glad) before this header.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "mesh_cache.h"
+
+const uint32_t PROGRAM_CACHE_MAGIC = meshLayoutTag('G', 'L', 'P', 'B');
+const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+inline bool programCacheEnabled = true; // programs turn this off with -nocache
+
+struct ProgramCacheHeader {
+    uint32_t magic, version;
+    uint64_t key;
+    uint32_t format, length; // binary format enum and byte count that follow
+};
+
+inline bool programBinarySupported() {
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    const char* v = (const char*)glGetString(GL_VERSION);
+    int major = 0, minor = 0;
+    bool ok = v && sscanf(v, "%d.%d", &major, &minor) == 2 && (major > 4 || (major == 4 && minor >= 1));
+    if (!ok && major >= 3) {
+        GLint n = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+        for (GLint i = 0; i < n && !ok; i++) {
+            const char* e = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            ok = e && strcmp(e, "GL_ARB_get_program_binary") == 0;
+        }
+    }
+    else if (!ok) {
+        const char* ext = (const char*)glGetString(GL_EXTENSIONS);
+        ok = ext && strstr(ext, "GL_ARB_get_program_binary");
+    }
+    GLint formats = 0;
+    if (ok) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+#else
+    return false;
+#endif
+}
+
+// Key of a program: its concatenated stage sources plus the driver identity
+inline uint64_t programCacheKey(const std::string& sources) {
+    uint64_t h = fnv1a(sources.data(), sources.size());
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+        const char* s = (const char*)glGetString(name);
+        if (s) h = fnv1a(s, strlen(s) + 1, h);
+    }
+    return fnv1a(&PROGRAM_CACHE_VERSION, sizeof(PROGRAM_CACHE_VERSION), h);
+}
+
+inline std::string programCachePath(uint64_t key) {
+    char name[40];
+    snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+    return (std::filesystem::path("shader_cache") / name).string();
+}
+
+// Loads the cached binary into `prog`; true only if the driver linked it
+inline bool loadProgramBinary(uint64_t key, GLuint prog) {
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    FILE* f = fopen(programCachePath(key).c_str(), "rb");
+    if (!f) return false;
+    ProgramCacheHeader h;
+    std::vector<char> data;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 && h.magic == PROGRAM_CACHE_MAGIC &&
+              h.version == PROGRAM_CACHE_VERSION && h.key == key && h.length > 0;
+    if (ok) {
+        data.resize(h.length);
+        ok = fread(data.data(), 1, data.size(), f) == data.size();
+    }
+    fclose(f);
+    if (!ok) return false;
+    glProgramBinary(prog, h.format, data.data(), (GLsizei)data.size());
+    GLint linked = 0;
+    glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+    return linked != 0;
+#else
+    (void)key; (void)prog;
+    return false;
+#endif
+}
+
+// Stores a program linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+inline bool saveProgramBinary(uint64_t key, GLuint prog) {
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    GLint len = 0;
+    glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &len);
+    if (len <= 0) return false;
+    std::vector<char> data(len);
+    GLenum format = 0;
+    glGetProgramBinary(prog, len, &len, &format, data.data());
+    if (len <= 0) return false;
+
+    std::string path = programCachePath(key), tmp = path + ".tmp";
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    ProgramCacheHeader h = { PROGRAM_CACHE_MAGIC, PROGRAM_CACHE_VERSION, key, (uint32_t)format, (uint32_t)len };
+    FILE* f = fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(data.data(), 1, (size_t)len, f) == (size_t)len;
+    ok = fclose(f) == 0 && ok;
+    if (ok) {
+        std::filesystem::rename(tmp, path, ec);
+        ok = !ec;
+    }
+    if (!ok) std::filesystem::remove(tmp, ec);
+    return ok;
+#else
+    (void)key; (void)prog;
+    return false;
+#endif
+}
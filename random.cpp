@@ -1,5 +1,7 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "gl_program.h"
+#include "headless.h"
 #include <cmath>
 #include <iostream>
 
@@ -20,47 +22,6 @@ const char* fragmentShaderSource = R"(
     }
 )";
 
-unsigned int createShaderProgram() {
-    int success;
-    char infoLog[512];
-
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cerr << "Vertex shader error: " << infoLog << std::endl;
-    }
-
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cerr << "Fragment shader error: " << infoLog << std::endl;
-    }
-
-    unsigned int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cerr << "Shader program error: " << infoLog << std::endl;
-    }
-
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
-
-    return shaderProgram;
-}
-
 void generateCircle(float* vertices, int segments, float radius, float xOffset) {
     vertices[0] = xOffset; 
     vertices[1] = 0.0f;    
@@ -74,26 +35,40 @@ void generateCircle(float* vertices, int segments, float radius, float xOffset)
     }
 }
 
-int main() {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    GLFWwindow* window = glfwCreateWindow(800, 600, "Three Shapes", NULL, NULL);
-    if (window == NULL) {
-        std::cerr << "Failed to create GLFW window\n";
-        glfwTerminate();
-        return -1;
+int main(int argc, char** argv) {
+    bool offscreen = headless().parse(argc, argv);
+    GLFWwindow* window = nullptr;
+    if (offscreen) {
+        if (!headless().createContext(3, 3, true)) return -1;
+        if (!gladLoadGLLoader((GLADloadproc)HeadlessRun::procAddress)) {
+            std::cerr << "Failed to initialize GLAD\n";
+            return -1;
+        }
+        if (!headless().createTarget(800, 600)) return -1;
     }
-    glfwMakeContextCurrent(window);
-
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        std::cerr << "Failed to initialize GLAD\n";
-        return -1;
+    else {
+        glfwInit();
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        window = glfwCreateWindow(800, 600, "Three Shapes", NULL, NULL);
+        if (window == NULL) {
+            std::cerr << "Failed to create GLFW window\n";
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            std::cerr << "Failed to initialize GLAD\n";
+            return -1;
+        }
     }
 
-    unsigned int shaderProgram = createShaderProgram();
+    GLProgram shaderProgram;
+    shaderProgram.build({ { GL_VERTEX_SHADER, vertexShaderSource }, { GL_FRAGMENT_SHADER, fragmentShaderSource } });
+    GLint shapeColorLoc = shaderProgram.uniform("shapeColor");
 
     float squareVertices[] = {
         -0.8f, -0.3f, 0.0f,
@@ -137,28 +112,36 @@ int main() {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glUseProgram(shaderProgram);
+    shaderProgram.use();
 
-    while (!glfwWindowShouldClose(window)) {
+    while (offscreen ? headless().nextFrame() : !glfwWindowShouldClose(window)) {
         glClearColor(0.9f, 0.9f, 0.9f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        glUniform3f(glGetUniformLocation(shaderProgram, "shapeColor"), 1.0f, 0.5f, 0.0f);
+        glUniform3f(shapeColorLoc, 1.0f, 0.5f, 0.0f);
         glBindVertexArray(VAOs[0]);
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
-        glUniform3f(glGetUniformLocation(shaderProgram, "shapeColor"), 0.0f, 0.8f, 0.2f);
+        glUniform3f(shapeColorLoc, 0.0f, 0.8f, 0.2f);
         glBindVertexArray(VAOs[1]);
         glDrawArrays(GL_TRIANGLES, 0, 3);
 
-        glUniform3f(glGetUniformLocation(shaderProgram, "shapeColor"), 1.0f, 0.0f, 0.0f);
+        glUniform3f(shapeColorLoc, 1.0f, 0.0f, 0.0f);
         glBindVertexArray(VAOs[2]);
         glDrawArrays(GL_TRIANGLE_FAN, 0, segments + 2);
+        headless().addWork(2 + 1 + segments);
 
+        if (offscreen) continue;
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+    if (offscreen) headless().report("random", "triangles");
 
+    shaderProgram.destroy();
+    if (offscreen) {
+        headless().destroy();
+        return 0;
+    }
     glfwTerminate();
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,268 @@
+// ray_pick.h
+// Picking on the CPU by ray casting through a two-level bounding volume
+// hierarchy. addMesh() builds a tree over a mesh's triangles once; the scene
+// is a list of instances (a mesh and an affine model matrix) with a tree over
+// their world-space boxes, rebuilt by setInstances() when objects move.
+// pick() walks the instance tree nearest box first, moves the ray into each
+// candidate's model space, walks that mesh's tree and keeps the nearest
+// triangle hit (Moller-Trumbore, either face). A subtree is skipped once its
+// box starts beyond the nearest hit so far.
+//
+// Trees split at the median centroid along the longest axis down to 4 items
+// per leaf: O(n log n) to build, about log n boxes visited per pick, so a
+// pick among 100k objects costs microseconds.
+//
+// screenRay() turns a window pixel into a world-space ray for a camera built
+// with perspective() and lookAt(). Needs vec_math.h and bezier_model.h (for
+// ModelMesh); no GL calls.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "bezier_model.h"
+#include "vec_math.h"
+
+struct Ray {
+    Vec3 origin, dir; // dir need not be unit length
+};
+
+struct RayHit {
+    int instance = -1; // -1: nothing was hit
+    float t = 0.0f;    // hit at origin + t * dir
+    Vec3 position;     // world space
+    unsigned int triangle = 0;
+};
+
+// Window pixel (x right, y down, as GLUT reports the mouse) to a ray from
+// the eye; view must be a rotation plus a translation
+inline Ray screenRay(const Mat4& proj, const Mat4& view, float x, float y, int w, int h) {
+    float ndcX = 2.0f * (x + 0.5f) / w - 1.0f, ndcY = 1.0f - 2.0f * (y + 0.5f) / h;
+    Mat3 toWorld = transpose(upperLeft3(view));
+    Ray r;
+    r.origin = transformVector(toWorld, Vec3(-view.m[12], -view.m[13], -view.m[14]));
+    r.dir = transformVector(toWorld, Vec3(ndcX / proj.m[0], ndcY / proj.m[5], -1.0f));
+    return r;
+}
+
+class Bvh {
+public:
+    struct Node {
+        Vec3 lo, hi;
+        unsigned int first, count; // leaf: items [first, first + count); inner (count 0): nodes first, first + 1
+    };
+
+    std::vector<Node> nodes;
+    std::vector<unsigned int> items;
+
+    // lo[i], hi[i]: the box of item i
+    void build(const std::vector<Vec3>& lo, const std::vector<Vec3>& hi, unsigned int leafSize = 4) {
+        size_t n = lo.size();
+        nodes.clear();
+        items.resize(n);
+        std::vector<Vec3> centroid(n);
+        for (size_t i = 0; i < n; i++) {
+            items[i] = (unsigned int)i;
+            centroid[i] = (lo[i] + hi[i]) * 0.5f;
+        }
+        if (n == 0) return;
+        nodes.reserve(2 * n / leafSize + 1);
+        nodes.push_back(Node());
+        struct Task { unsigned int node, begin, end; };
+        std::vector<Task> todo = { { 0, 0, (unsigned int)n } };
+        while (!todo.empty()) {
+            Task t = todo.back();
+            todo.pop_back();
+            Vec3 bl(1e30f, 1e30f, 1e30f), bh(-1e30f, -1e30f, -1e30f);
+            Vec3 cl = bl, ch = bh;
+            for (unsigned int k = t.begin; k < t.end; k++) {
+                unsigned int i = items[k];
+                bl = minv(bl, lo[i]);
+                bh = maxv(bh, hi[i]);
+                cl = minv(cl, centroid[i]);
+                ch = maxv(ch, centroid[i]);
+            }
+            Node& node = nodes[t.node];
+            node.lo = bl;
+            node.hi = bh;
+            if (t.end - t.begin <= leafSize) {
+                node.first = t.begin;
+                node.count = t.end - t.begin;
+                continue;
+            }
+            Vec3 ext = ch - cl;
+            int axis = ext.x >= ext.y && ext.x >= ext.z ? 0 : ext.y >= ext.z ? 1 : 2;
+            unsigned int mid = (t.begin + t.end) / 2;
+            std::nth_element(items.begin() + t.begin, items.begin() + mid, items.begin() + t.end,
+                             [&](unsigned int a, unsigned int b) { return comp(centroid[a], axis) < comp(centroid[b], axis); });
+            unsigned int left = (unsigned int)nodes.size();
+            node.first = left;
+            node.count = 0;
+            nodes.push_back(Node());
+            nodes.push_back(Node());
+            todo.push_back({ left, t.begin, mid });
+            todo.push_back({ left + 1, mid, t.end });
+        }
+    }
+
+    // Calls hit(item, tMax) for the items of each leaf the ray enters before
+    // tMax, nearer boxes first; hit() lowers tMax when it finds a hit
+    template <class F>
+    void traverse(const Ray& r, float& tMax, F&& hit) const {
+        if (nodes.empty()) return;
+        Vec3 inv(1.0f / r.dir.x, 1.0f / r.dir.y, 1.0f / r.dir.z);
+        struct Entry { unsigned int node; float t; };
+        Entry stack[64];
+        int top = 0;
+        float t0 = enter(nodes[0], r.origin, inv);
+        if (t0 < tMax) stack[top++] = { 0, t0 };
+        while (top > 0) {
+            Entry e = stack[--top];
+            if (e.t >= tMax) continue;
+            const Node& node = nodes[e.node];
+            if (node.count > 0) {
+                for (unsigned int k = node.first; k < node.first + node.count; k++) hit(items[k], tMax);
+                continue;
+            }
+            float ta = enter(nodes[node.first], r.origin, inv), tb = enter(nodes[node.first + 1], r.origin, inv);
+            Entry a = { node.first, ta }, b = { node.first + 1, tb };
+            if (ta > tb) std::swap(a, b);
+            if (b.t < tMax && top < 64) stack[top++] = b; // the depth stays near log2(n / 4)
+            if (a.t < tMax && top < 64) stack[top++] = a;
+        }
+    }
+
+private:
+    static Vec3 minv(const Vec3& a, const Vec3& b) { return Vec3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)); }
+    static Vec3 maxv(const Vec3& a, const Vec3& b) { return Vec3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)); }
+    static float comp(const Vec3& v, int axis) { return axis == 0 ? v.x : axis == 1 ? v.y : v.z; }
+
+    // Ray parameter where the box is entered (0 when the origin is inside),
+    // 1e30 when it is missed
+    static float enter(const Node& n, const Vec3& o, const Vec3& inv) {
+        float tx0 = (n.lo.x - o.x) * inv.x, tx1 = (n.hi.x - o.x) * inv.x;
+        float ty0 = (n.lo.y - o.y) * inv.y, ty1 = (n.hi.y - o.y) * inv.y;
+        float tz0 = (n.lo.z - o.z) * inv.z, tz1 = (n.hi.z - o.z) * inv.z;
+        float tmin = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), 0.0f));
+        float tmax = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::max(tz0, tz1));
+        return tmin <= tmax ? tmin : 1e30f;
+    }
+};
+
+struct PickInstance {
+    int mesh; // from RayPicker::addMesh()
+    Mat4 model;
+};
+
+class RayPicker {
+public:
+    // Copies the positions and triangles; returns the id for PickInstance::mesh
+    int addMesh(const ModelMesh& m) {
+        meshes.emplace_back();
+        Mesh& mesh = meshes.back();
+        mesh.pos.resize(m.vertexCount());
+        for (size_t v = 0; v < mesh.pos.size(); v++) mesh.pos[v] = Vec3(m.pos[v * 3], m.pos[v * 3 + 1], m.pos[v * 3 + 2]);
+        mesh.inds = m.inds;
+        size_t tris = mesh.inds.size() / 3;
+        std::vector<Vec3> lo(tris), hi(tris);
+        for (size_t t = 0; t < tris; t++) {
+            const Vec3 &a = mesh.pos[mesh.inds[t * 3]], &b = mesh.pos[mesh.inds[t * 3 + 1]], &c = mesh.pos[mesh.inds[t * 3 + 2]];
+            lo[t] = Vec3(std::min(a.x, std::min(b.x, c.x)), std::min(a.y, std::min(b.y, c.y)), std::min(a.z, std::min(b.z, c.z)));
+            hi[t] = Vec3(std::max(a.x, std::max(b.x, c.x)), std::max(a.y, std::max(b.y, c.y)), std::max(a.z, std::max(b.z, c.z)));
+        }
+        mesh.bvh.build(lo, hi);
+        return (int)meshes.size() - 1;
+    }
+
+    // Replaces the scene; instance i of the list is RayHit::instance i
+    void setInstances(const PickInstance* list, size_t n) {
+        instances.resize(n);
+        std::vector<Vec3> lo(n), hi(n);
+        for (size_t i = 0; i < n; i++) {
+            Instance& in = instances[i];
+            const Mesh& mesh = meshes[list[i].mesh];
+            in.mesh = list[i].mesh;
+            Mat3 M = upperLeft3(list[i].model);
+            in.translation = Vec3(list[i].model.m[12], list[i].model.m[13], list[i].model.m[14]);
+            in.valid = inverse(M, in.toModel) && !mesh.bvh.nodes.empty();
+            if (!in.valid) {
+                lo[i] = hi[i] = in.translation;
+                continue;
+            }
+            // world box of the transformed mesh box: center moved, extent through |M|
+            const Bvh::Node& root = mesh.bvh.nodes[0];
+            Vec3 c = transformVector(M, (root.lo + root.hi) * 0.5f) + in.translation, e = (root.hi - root.lo) * 0.5f;
+            Vec3 ext(fabsf(M.m[0]) * e.x + fabsf(M.m[4]) * e.y + fabsf(M.m[8]) * e.z,
+                     fabsf(M.m[1]) * e.x + fabsf(M.m[5]) * e.y + fabsf(M.m[9]) * e.z,
+                     fabsf(M.m[2]) * e.x + fabsf(M.m[6]) * e.y + fabsf(M.m[10]) * e.z);
+            lo[i] = c - ext;
+            hi[i] = c + ext;
+        }
+        tree.build(lo, hi);
+    }
+
+    size_t instanceCount() const { return instances.size(); }
+
+    // Nearest hit along the ray, with t > 0
+    RayHit pick(const Ray& ray) const {
+        RayHit best;
+        float tMax = 1e30f;
+        tree.traverse(ray, tMax, [&](unsigned int i, float& tm) {
+            const Instance& in = instances[i];
+            if (!in.valid) return;
+            // t is the same in model space since dir is transformed along
+            Ray local = { transformVector(in.toModel, ray.origin - in.translation), transformVector(in.toModel, ray.dir) };
+            const Mesh& mesh = meshes[in.mesh];
+            mesh.bvh.traverse(local, tm, [&](unsigned int tri, float& tmesh) {
+                float t;
+                if (!intersectTriangle(local, mesh.pos[mesh.inds[tri * 3]], mesh.pos[mesh.inds[tri * 3 + 1]],
+                                       mesh.pos[mesh.inds[tri * 3 + 2]], tmesh, t))
+                    return;
+                tmesh = t;
+                best.instance = (int)i;
+                best.triangle = tri;
+            });
+        });
+        if (best.instance >= 0) {
+            best.t = tMax;
+            best.position = ray.origin + ray.dir * tMax;
+        }
+        return best;
+    }
+
+private:
+    struct Mesh {
+        std::vector<Vec3> pos;
+        std::vector<unsigned int> inds;
+        Bvh bvh;
+    };
+    struct Instance {
+        int mesh;
+        bool valid;  // false for a singular model matrix
+        Mat3 toModel; // inverse of the model matrix's 3x3
+        Vec3 translation;
+    };
+
+    std::vector<Mesh> meshes;
+    std::vector<Instance> instances;
+    Bvh tree;
+
+    // Moller-Trumbore; either face, 0 < t < tMax
+    static bool intersectTriangle(const Ray& r, const Vec3& a, const Vec3& b, const Vec3& c, float tMax, float& t) {
+        Vec3 e1 = b - a, e2 = c - a;
+        Vec3 p = crossp(r.dir, e2);
+        float det = dotp(e1, p);
+        if (fabsf(det) < 1e-20f) return false;
+        float inv = 1.0f / det;
+        Vec3 s = r.origin - a;
+        float u = dotp(s, p) * inv;
+        if (u < 0.0f || u > 1.0f) return false;
+        Vec3 q = crossp(s, e1);
+        float v = dotp(r.dir, q) * inv;
+        if (v < 0.0f || u + v > 1.0f) return false;
+        t = dotp(e2, q) * inv;
+        return t > 0.0f && t < tMax;
+    }
+};
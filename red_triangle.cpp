@@ -2,6 +2,8 @@
 #define GL_SILENCE_DEPRECATION
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "gl_program.h"
+#include "headless.h"
 
 const char* vertexShaderSrc = R"glsl(
 #version 330 core
@@ -19,29 +21,31 @@ void main(){
 }
 )glsl";
 
-void checkCompile(GLuint shader) {
-    GLint ok;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
-    if (!ok) {
-        char buf[512]; glGetShaderInfoLog(shader, 512, NULL, buf);
-        std::cerr << "SHADER COMPILE ERROR:\n" << buf << std::endl;
+int main(int argc, char** argv){
+    bool offscreen = headless().parse(argc, argv);
+    GLFWwindow* win = nullptr;
+    if (offscreen){
+        if (!headless().createContext(3, 3, true)) return -1;
+        if (!gladLoadGLLoader((GLADloadproc)HeadlessRun::procAddress)){
+            std::cerr << "Failed to initialize GLAD\n"; return -1;
+        }
+        if (!headless().createTarget(800, 600)) return -1;
     }
-}
-
-int main(){
-    if (!glfwInit()){ std::cerr << "Failed to init GLFW\n"; return -1; }
+    else {
+        if (!glfwInit()){ std::cerr << "Failed to init GLFW\n"; return -1; }
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); 
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); 
 
-    GLFWwindow* win = glfwCreateWindow(800, 600, "Red Triangle", NULL, NULL);
-    if (!win){ std::cerr << "Failed to create window\n"; glfwTerminate(); return -1; }
-    glfwMakeContextCurrent(win);
+        win = glfwCreateWindow(800, 600, "Red Triangle", NULL, NULL);
+        if (!win){ std::cerr << "Failed to create window\n"; glfwTerminate(); return -1; }
+        glfwMakeContextCurrent(win);
 
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)){
-        std::cerr << "Failed to initialize GLAD\n"; return -1;
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)){
+            std::cerr << "Failed to initialize GLAD\n"; return -1;
+        }
     }
 
     float vertices[] = {
@@ -60,35 +64,28 @@ int main(){
     glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,3*sizeof(float),(void*)0);
     glEnableVertexAttribArray(0);
 
-    GLuint vs = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vs,1,&vertexShaderSrc,NULL);
-    glCompileShader(vs); checkCompile(vs);
-
-    GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fs,1,&fragmentShaderSrc,NULL);
-    glCompileShader(fs); checkCompile(fs);
-
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, vs);
-    glAttachShader(prog, fs);
-    glLinkProgram(prog);
-
-    glDeleteShader(vs); glDeleteShader(fs);
+    GLProgram prog;
+    prog.build({ { GL_VERTEX_SHADER, vertexShaderSrc }, { GL_FRAGMENT_SHADER, fragmentShaderSrc } });
 
-    while (!glfwWindowShouldClose(win)){
+    while (offscreen ? headless().nextFrame() : !glfwWindowShouldClose(win)){
         glClearColor(0.2f,0.3f,0.3f,1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
 
-        glUseProgram(prog);
+        prog.use();
         glBindVertexArray(VAO);
         glDrawArrays(GL_TRIANGLES, 0, 3);
+        headless().addWork(1);
 
+        if (offscreen) continue;
         glfwSwapBuffers(win);
         glfwPollEvents();
     }
+    if (offscreen) headless().report("red_triangle", "triangles");
 
     glDeleteVertexArrays(1,&VAO);
     glDeleteBuffers(1,&VBO);
+    prog.destroy();
+    if (offscreen){ headless().destroy(); return 0; }
     glfwDestroyWindow(win);
     glfwTerminate();
     return 0;
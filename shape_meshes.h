@@ -0,0 +1,205 @@
+// shape_meshes.h
+// Triangle meshes of GLUT's solids, built once on the CPU so a program can
+// draw them from arrays and test rays against exactly what it draws.
+// makeSphereMesh() and makeTorusMesh() lay out vertices the way
+// glutSolidSphere() and glutSolidTorus() do (z is the axis); makeTeapotMesh()
+// tessellates Newell's 32 patches with the patch evaluator of bezier_model.h
+// and places the result like glutSolidTeapot(): y up, scaled by size / 2
+// after moving the base 1.5 below the origin.
+//
+// Every mesh is a welded, indexed triangle list in a ModelMesh with unit
+// normals and uvs (the teapot keeps a vertex per patch where patch uvs meet,
+// see weldVertices()); triangles are counter-clockwise seen from outside.
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "bezier_model.h"
+
+// Newell's teapot, z up: 294 control points and 32 bicubic patches of 16
+// point indices each, u varying fastest as in a .bpt file
+const float teapotPoints[294][3] = {
+    { 1.4f, 0.0f, 2.4f }, { 1.4f, -0.784f, 2.4f }, { 0.784f, -1.4f, 2.4f }, { 0.0f, -1.4f, 2.4f },
+    { 1.3375f, 0.0f, 2.53125f }, { 1.3375f, -0.749f, 2.53125f }, { 0.749f, -1.3375f, 2.53125f }, { 0.0f, -1.3375f, 2.53125f },
+    { 1.4375f, 0.0f, 2.53125f }, { 1.4375f, -0.805f, 2.53125f }, { 0.805f, -1.4375f, 2.53125f }, { 0.0f, -1.4375f, 2.53125f },
+    { 1.5f, 0.0f, 2.4f }, { 1.5f, -0.84f, 2.4f }, { 0.84f, -1.5f, 2.4f }, { 0.0f, -1.5f, 2.4f },
+    { 0.0f, 1.4f, 2.4f }, { 0.784f, 1.4f, 2.4f }, { 1.4f, 0.784f, 2.4f }, { 0.0f, 1.3375f, 2.53125f },
+    { 0.749f, 1.3375f, 2.53125f }, { 1.3375f, 0.749f, 2.53125f }, { 0.0f, 1.4375f, 2.53125f }, { 0.805f, 1.4375f, 2.53125f },
+    { 1.4375f, 0.805f, 2.53125f }, { 0.0f, 1.5f, 2.4f }, { 0.84f, 1.5f, 2.4f }, { 1.5f, 0.84f, 2.4f },
+    { -0.784f, -1.4f, 2.4f }, { -1.4f, -0.784f, 2.4f }, { -1.4f, 0.0f, 2.4f }, { -0.749f, -1.3375f, 2.53125f },
+    { -1.3375f, -0.749f, 2.53125f }, { -1.3375f, 0.0f, 2.53125f }, { -0.805f, -1.4375f, 2.53125f }, { -1.4375f, -0.805f, 2.53125f },
+    { -1.4375f, 0.0f, 2.53125f }, { -0.84f, -1.5f, 2.4f }, { -1.5f, -0.84f, 2.4f }, { -1.5f, 0.0f, 2.4f },
+    { -1.4f, 0.784f, 2.4f }, { -0.784f, 1.4f, 2.4f }, { -1.3375f, 0.749f, 2.53125f }, { -0.749f, 1.3375f, 2.53125f },
+    { -1.4375f, 0.805f, 2.53125f }, { -0.805f, 1.4375f, 2.53125f }, { -1.5f, 0.84f, 2.4f }, { -0.84f, 1.5f, 2.4f },
+    { 1.75f, 0.0f, 1.875f }, { 1.75f, -0.98f, 1.875f }, { 0.98f, -1.75f, 1.875f }, { 0.0f, -1.75f, 1.875f },
+    { 2.0f, 0.0f, 1.35f }, { 2.0f, -1.12f, 1.35f }, { 1.12f, -2.0f, 1.35f }, { 0.0f, -2.0f, 1.35f },
+    { 2.0f, 0.0f, 0.9f }, { 2.0f, -1.12f, 0.9f }, { 1.12f, -2.0f, 0.9f }, { 0.0f, -2.0f, 0.9f },
+    { 0.0f, 1.75f, 1.875f }, { 0.98f, 1.75f, 1.875f }, { 1.75f, 0.98f, 1.875f }, { 0.0f, 2.0f, 1.35f },
+    { 1.12f, 2.0f, 1.35f }, { 2.0f, 1.12f, 1.35f }, { 0.0f, 2.0f, 0.9f }, { 1.12f, 2.0f, 0.9f },
+    { 2.0f, 1.12f, 0.9f }, { -0.98f, -1.75f, 1.875f }, { -1.75f, -0.98f, 1.875f }, { -1.75f, 0.0f, 1.875f },
+    { -1.12f, -2.0f, 1.35f }, { -2.0f, -1.12f, 1.35f }, { -2.0f, 0.0f, 1.35f }, { -1.12f, -2.0f, 0.9f },
+    { -2.0f, -1.12f, 0.9f }, { -2.0f, 0.0f, 0.9f }, { -1.75f, 0.98f, 1.875f }, { -0.98f, 1.75f, 1.875f },
+    { -2.0f, 1.12f, 1.35f }, { -1.12f, 2.0f, 1.35f }, { -2.0f, 1.12f, 0.9f }, { -1.12f, 2.0f, 0.9f },
+    { 2.0f, 0.0f, 0.45f }, { 2.0f, -1.12f, 0.45f }, { 1.12f, -2.0f, 0.45f }, { 0.0f, -2.0f, 0.45f },
+    { 1.5f, 0.0f, 0.225f }, { 1.5f, -0.84f, 0.225f }, { 0.84f, -1.5f, 0.225f }, { 0.0f, -1.5f, 0.225f },
+    { 1.5f, 0.0f, 0.15f }, { 1.5f, -0.84f, 0.15f }, { 0.84f, -1.5f, 0.15f }, { 0.0f, -1.5f, 0.15f },
+    { 0.0f, 2.0f, 0.45f }, { 1.12f, 2.0f, 0.45f }, { 2.0f, 1.12f, 0.45f }, { 0.0f, 1.5f, 0.225f },
+    { 0.84f, 1.5f, 0.225f }, { 1.5f, 0.84f, 0.225f }, { 0.0f, 1.5f, 0.15f }, { 0.84f, 1.5f, 0.15f },
+    { 1.5f, 0.84f, 0.15f }, { -1.12f, -2.0f, 0.45f }, { -2.0f, -1.12f, 0.45f }, { -2.0f, 0.0f, 0.45f },
+    { -0.84f, -1.5f, 0.225f }, { -1.5f, -0.84f, 0.225f }, { -1.5f, 0.0f, 0.225f }, { -0.84f, -1.5f, 0.15f },
+    { -1.5f, -0.84f, 0.15f }, { -1.5f, 0.0f, 0.15f }, { -2.0f, 1.12f, 0.45f }, { -1.12f, 2.0f, 0.45f },
+    { -1.5f, 0.84f, 0.225f }, { -0.84f, 1.5f, 0.225f }, { -1.5f, 0.84f, 0.15f }, { -0.84f, 1.5f, 0.15f },
+    { 0.0f, 0.0f, 3.15f }, { 0.0f, -0.002f, 3.15f }, { 0.002f, 0.0f, 3.15f }, { 0.8f, 0.0f, 3.15f },
+    { 0.8f, -0.45f, 3.15f }, { 0.45f, -0.8f, 3.15f }, { 0.0f, -0.8f, 3.15f }, { 0.0f, 0.0f, 2.85f },
+    { 0.2f, 0.0f, 2.7f }, { 0.2f, -0.112f, 2.7f }, { 0.112f, -0.2f, 2.7f }, { 0.0f, -0.2f, 2.7f },
+    { 0.0f, 0.002f, 3.15f }, { 0.0f, 0.8f, 3.15f }, { 0.45f, 0.8f, 3.15f }, { 0.8f, 0.45f, 3.15f },
+    { 0.0f, 0.2f, 2.7f }, { 0.112f, 0.2f, 2.7f }, { 0.2f, 0.112f, 2.7f }, { -0.002f, 0.0f, 3.15f },
+    { -0.45f, -0.8f, 3.15f }, { -0.8f, -0.45f, 3.15f }, { -0.8f, 0.0f, 3.15f }, { -0.112f, -0.2f, 2.7f },
+    { -0.2f, -0.112f, 2.7f }, { -0.2f, 0.0f, 2.7f }, { -0.8f, 0.45f, 3.15f }, { -0.45f, 0.8f, 3.15f },
+    { -0.2f, 0.112f, 2.7f }, { -0.112f, 0.2f, 2.7f }, { 0.4f, 0.0f, 2.55f }, { 0.4f, -0.224f, 2.55f },
+    { 0.224f, -0.4f, 2.55f }, { 0.0f, -0.4f, 2.55f }, { 1.3f, 0.0f, 2.55f }, { 1.3f, -0.728f, 2.55f },
+    { 0.728f, -1.3f, 2.55f }, { 0.0f, -1.3f, 2.55f }, { 1.3f, 0.0f, 2.4f }, { 1.3f, -0.728f, 2.4f },
+    { 0.728f, -1.3f, 2.4f }, { 0.0f, -1.3f, 2.4f }, { 0.0f, 0.4f, 2.55f }, { 0.224f, 0.4f, 2.55f },
+    { 0.4f, 0.224f, 2.55f }, { 0.0f, 1.3f, 2.55f }, { 0.728f, 1.3f, 2.55f }, { 1.3f, 0.728f, 2.55f },
+    { 0.0f, 1.3f, 2.4f }, { 0.728f, 1.3f, 2.4f }, { 1.3f, 0.728f, 2.4f }, { -0.224f, -0.4f, 2.55f },
+    { -0.4f, -0.224f, 2.55f }, { -0.4f, 0.0f, 2.55f }, { -0.728f, -1.3f, 2.55f }, { -1.3f, -0.728f, 2.55f },
+    { -1.3f, 0.0f, 2.55f }, { -0.728f, -1.3f, 2.4f }, { -1.3f, -0.728f, 2.4f }, { -1.3f, 0.0f, 2.4f },
+    { -0.4f, 0.224f, 2.55f }, { -0.224f, 0.4f, 2.55f }, { -1.3f, 0.728f, 2.55f }, { -0.728f, 1.3f, 2.55f },
+    { -1.3f, 0.728f, 2.4f }, { -0.728f, 1.3f, 2.4f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, -1.425f, 0.0f },
+    { 0.798f, -1.425f, 0.0f }, { 1.425f, -0.798f, 0.0f }, { 1.425f, 0.0f, 0.0f }, { 0.0f, -1.5f, 0.075f },
+    { 0.84f, -1.5f, 0.075f }, { 1.5f, -0.84f, 0.075f }, { 1.5f, 0.0f, 0.075f }, { 1.425f, 0.798f, 0.0f },
+    { 0.798f, 1.425f, 0.0f }, { 0.0f, 1.425f, 0.0f }, { 1.5f, 0.84f, 0.075f }, { 0.84f, 1.5f, 0.075f },
+    { 0.0f, 1.5f, 0.075f }, { -1.425f, 0.0f, 0.0f }, { -1.425f, -0.798f, 0.0f }, { -0.798f, -1.425f, 0.0f },
+    { -1.5f, 0.0f, 0.075f }, { -1.5f, -0.84f, 0.075f }, { -0.84f, -1.5f, 0.075f }, { -0.798f, 1.425f, 0.0f },
+    { -1.425f, 0.798f, 0.0f }, { -0.84f, 1.5f, 0.075f }, { -1.5f, 0.84f, 0.075f }, { -1.6f, 0.0f, 2.025f },
+    { -1.6f, -0.3f, 2.025f }, { -1.5f, -0.3f, 2.25f }, { -1.5f, 0.0f, 2.25f }, { -2.3f, 0.0f, 2.025f },
+    { -2.3f, -0.3f, 2.025f }, { -2.5f, -0.3f, 2.25f }, { -2.5f, 0.0f, 2.25f }, { -2.7f, 0.0f, 2.025f },
+    { -2.7f, -0.3f, 2.025f }, { -3.0f, -0.3f, 2.25f }, { -3.0f, 0.0f, 2.25f }, { -2.7f, 0.0f, 1.8f },
+    { -2.7f, -0.3f, 1.8f }, { -3.0f, -0.3f, 1.8f }, { -3.0f, 0.0f, 1.8f }, { -1.5f, 0.3f, 2.25f },
+    { -1.6f, 0.3f, 2.025f }, { -2.5f, 0.3f, 2.25f }, { -2.3f, 0.3f, 2.025f }, { -3.0f, 0.3f, 2.25f },
+    { -2.7f, 0.3f, 2.025f }, { -3.0f, 0.3f, 1.8f }, { -2.7f, 0.3f, 1.8f }, { -2.7f, 0.0f, 1.575f },
+    { -2.7f, -0.3f, 1.575f }, { -3.0f, -0.3f, 1.35f }, { -3.0f, 0.0f, 1.35f }, { -2.5f, 0.0f, 1.125f },
+    { -2.5f, -0.3f, 1.125f }, { -2.65f, -0.3f, 0.9375f }, { -2.65f, 0.0f, 0.9375f }, { -2.0f, -0.3f, 0.9f },
+    { -1.9f, -0.3f, 0.6f }, { -1.9f, 0.0f, 0.6f }, { -3.0f, 0.3f, 1.35f }, { -2.7f, 0.3f, 1.575f },
+    { -2.65f, 0.3f, 0.9375f }, { -2.5f, 0.3f, 1.125f }, { -1.9f, 0.3f, 0.6f }, { -2.0f, 0.3f, 0.9f },
+    { 1.7f, 0.0f, 1.425f }, { 1.7f, -0.66f, 1.425f }, { 1.7f, -0.66f, 0.6f }, { 1.7f, 0.0f, 0.6f },
+    { 2.6f, 0.0f, 1.425f }, { 2.6f, -0.66f, 1.425f }, { 3.1f, -0.66f, 0.825f }, { 3.1f, 0.0f, 0.825f },
+    { 2.3f, 0.0f, 2.1f }, { 2.3f, -0.25f, 2.1f }, { 2.4f, -0.25f, 2.025f }, { 2.4f, 0.0f, 2.025f },
+    { 2.7f, 0.0f, 2.4f }, { 2.7f, -0.25f, 2.4f }, { 3.3f, -0.25f, 2.4f }, { 3.3f, 0.0f, 2.4f },
+    { 1.7f, 0.66f, 0.6f }, { 1.7f, 0.66f, 1.425f }, { 3.1f, 0.66f, 0.825f }, { 2.6f, 0.66f, 1.425f },
+    { 2.4f, 0.25f, 2.025f }, { 2.3f, 0.25f, 2.1f }, { 3.3f, 0.25f, 2.4f }, { 2.7f, 0.25f, 2.4f },
+    { 2.8f, 0.0f, 2.475f }, { 2.8f, -0.25f, 2.475f }, { 3.525f, -0.25f, 2.49375f }, { 3.525f, 0.0f, 2.49375f },
+    { 2.9f, 0.0f, 2.475f }, { 2.9f, -0.15f, 2.475f }, { 3.45f, -0.15f, 2.5125f }, { 3.45f, 0.0f, 2.5125f },
+    { 2.8f, 0.0f, 2.4f }, { 2.8f, -0.15f, 2.4f }, { 3.2f, -0.15f, 2.4f }, { 3.2f, 0.0f, 2.4f },
+    { 3.525f, 0.25f, 2.49375f }, { 2.8f, 0.25f, 2.475f }, { 3.45f, 0.15f, 2.5125f }, { 2.9f, 0.15f, 2.475f },
+    { 3.2f, 0.15f, 2.4f }, { 2.8f, 0.15f, 2.4f },
+};
+const unsigned short teapotPatches[32][16] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+    { 16, 17, 18, 0, 19, 20, 21, 4, 22, 23, 24, 8, 25, 26, 27, 12 },
+    { 3, 28, 29, 30, 7, 31, 32, 33, 11, 34, 35, 36, 15, 37, 38, 39 },
+    { 30, 40, 41, 16, 33, 42, 43, 19, 36, 44, 45, 22, 39, 46, 47, 25 },
+    { 12, 13, 14, 15, 48, 49, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59 },
+    { 25, 26, 27, 12, 60, 61, 62, 48, 63, 64, 65, 52, 66, 67, 68, 56 },
+    { 15, 37, 38, 39, 51, 69, 70, 71, 55, 72, 73, 74, 59, 75, 76, 77 },
+    { 39, 46, 47, 25, 71, 78, 79, 60, 74, 80, 81, 63, 77, 82, 83, 66 },
+    { 56, 57, 58, 59, 84, 85, 86, 87, 88, 89, 90, 91, 92, 93, 94, 95 },
+    { 66, 67, 68, 56, 96, 97, 98, 84, 99, 100, 101, 88, 102, 103, 104, 92 },
+    { 59, 75, 76, 77, 87, 105, 106, 107, 91, 108, 109, 110, 95, 111, 112, 113 },
+    { 77, 82, 83, 66, 107, 114, 115, 96, 110, 116, 117, 99, 113, 118, 119, 102 },
+    { 120, 121, 122, 120, 123, 124, 125, 126, 127, 127, 127, 127, 128, 129, 130, 131 },
+    { 120, 122, 132, 120, 133, 134, 135, 123, 127, 127, 127, 127, 136, 137, 138, 128 },
+    { 120, 139, 121, 120, 126, 140, 141, 142, 127, 127, 127, 127, 131, 143, 144, 145 },
+    { 120, 132, 139, 120, 142, 146, 147, 133, 127, 127, 127, 127, 145, 148, 149, 136 },
+    { 128, 129, 130, 131, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159, 160, 161 },
+    { 136, 137, 138, 128, 162, 163, 164, 150, 165, 166, 167, 154, 168, 169, 170, 158 },
+    { 131, 143, 144, 145, 153, 171, 172, 173, 157, 174, 175, 176, 161, 177, 178, 179 },
+    { 145, 148, 149, 136, 173, 180, 181, 162, 176, 182, 183, 165, 179, 184, 185, 168 },
+    { 186, 186, 186, 186, 187, 188, 189, 190, 191, 192, 193, 194, 95, 94, 93, 92 },
+    { 186, 186, 186, 186, 190, 195, 196, 197, 194, 198, 199, 200, 92, 104, 103, 102 },
+    { 186, 186, 186, 186, 201, 202, 203, 187, 204, 205, 206, 191, 113, 112, 111, 95 },
+    { 186, 186, 186, 186, 197, 207, 208, 201, 200, 209, 210, 204, 102, 119, 118, 113 },
+    { 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223, 224, 225, 226 },
+    { 214, 227, 228, 211, 218, 229, 230, 215, 222, 231, 232, 219, 226, 233, 234, 223 },
+    { 223, 224, 225, 226, 235, 236, 237, 238, 239, 240, 241, 242, 77, 243, 244, 245 },
+    { 226, 233, 234, 223, 238, 246, 247, 235, 242, 248, 249, 239, 245, 250, 251, 77 },
+    { 252, 253, 254, 255, 256, 257, 258, 259, 260, 261, 262, 263, 264, 265, 266, 267 },
+    { 255, 268, 269, 252, 259, 270, 271, 256, 263, 272, 273, 260, 267, 274, 275, 264 },
+    { 264, 265, 266, 267, 276, 277, 278, 279, 280, 281, 282, 283, 284, 285, 286, 287 },
+    { 267, 274, 275, 264, 279, 288, 289, 276, 283, 290, 291, 280, 287, 292, 293, 284 },
+};
+
+// (slices + 1) x (stacks + 1) grid from the +z pole down; the triangles that
+// would collapse onto a pole are left out
+inline void makeSphereMesh(float radius, int slices, int stacks, ModelMesh& mesh) {
+    mesh = ModelMesh();
+    const float pi = 3.14159265358979f;
+    for (int j = 0; j <= stacks; j++)
+        for (int i = 0; i <= slices; i++) {
+            float phi = pi * j / stacks, theta = 2.0f * pi * i / slices;
+            float n[3] = { sinf(phi) * cosf(theta), sinf(phi) * sinf(theta), cosf(phi) };
+            for (int c = 0; c < 3; c++) {
+                mesh.pos.push_back(radius * n[c]);
+                mesh.nrm.push_back(n[c]);
+            }
+            mesh.uv.push_back((float)i / slices);
+            mesh.uv.push_back((float)j / stacks);
+        }
+    unsigned int row = slices + 1;
+    for (int j = 0; j < stacks; j++)
+        for (int i = 0; i < slices; i++) {
+            unsigned int a = j * row + i, b = a + row, c = b + 1, d = a + 1;
+            if (j < stacks - 1) mesh.inds.insert(mesh.inds.end(), { a, b, c });
+            if (j > 0) mesh.inds.insert(mesh.inds.end(), { a, c, d });
+        }
+}
+
+// Tube of radius r around a circle of radius R in the xy plane
+inline void makeTorusMesh(float r, float R, int sides, int rings, ModelMesh& mesh) {
+    mesh = ModelMesh();
+    const float pi = 3.14159265358979f;
+    for (int i = 0; i <= rings; i++)
+        for (int j = 0; j <= sides; j++) {
+            float u = 2.0f * pi * i / rings, v = 2.0f * pi * j / sides;
+            float n[3] = { cosf(v) * cosf(u), cosf(v) * sinf(u), sinf(v) };
+            mesh.pos.insert(mesh.pos.end(), { (R + r * cosf(v)) * cosf(u), (R + r * cosf(v)) * sinf(u), r * sinf(v) });
+            mesh.nrm.insert(mesh.nrm.end(), n, n + 3);
+            mesh.uv.push_back((float)i / rings);
+            mesh.uv.push_back((float)j / sides);
+        }
+    unsigned int row = sides + 1;
+    for (int i = 0; i < rings; i++)
+        for (int j = 0; j < sides; j++) {
+            unsigned int a = i * row + j, b = a + row, c = b + 1, d = a + 1;
+            mesh.inds.insert(mesh.inds.end(), { a, b, c, a, c, d });
+        }
+}
+
+inline BezierModel teapotModel() {
+    BezierModel m;
+    m.patchCount = 32;
+    m.ctrl.resize(32 * 48);
+    for (int p = 0; p < 32; p++)
+        for (int k = 0; k < 16; k++) {
+            int i = k % 4, j = k / 4; // same order as loadBpt()
+            for (int c = 0; c < 3; c++) m.ctrl[p * 48 + (i * 4 + j) * 3 + c] = teapotPoints[teapotPatches[p][k]][c];
+        }
+    return m;
+}
+
+// res x res vertices per patch before welding
+inline void makeTeapotMesh(float size, int res, ModelMesh& mesh) {
+    tessellateModel(teapotModel(), res, mesh);
+    float s = 0.5f * size;
+    for (size_t v = 0; v < mesh.vertexCount(); v++) {
+        float* P = &mesh.pos[v * 3];
+        float* N = &mesh.nrm[v * 3];
+        // glRotatef(270, 1, 0, 0): (x, y, z) -> (x, z, -y)
+        float px = P[0], py = P[1], pz = P[2] - 1.5f;
+        P[0] = s * px; P[1] = s * pz; P[2] = -s * py;
+        float ny = N[1];
+        N[1] = N[2]; N[2] = -ny;
+    }
+}
@@ -0,0 +1,199 @@
+// stream_buffer.h
+// Ring buffer for vertex data that changes often. Writes are sub-allocated
+// from one fixed GL buffer, so updates neither reallocate GPU memory nor wait
+// for the driver to finish with the previous contents.
+//
+// With GL 4.4 / GL_ARB_buffer_storage the buffer is mapped once, persistent
+// and coherent, and writes are plain memcpys. Otherwise each write maps just
+// its range with GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT.
+// In both cases fence() inserts a glFenceSync covering everything written (or
+// marked with use()) since the previous fence, and a write that wraps onto a
+// range waits only for the fences that still cover it. Data drawn once
+// needs nothing extra; data that stays on screen across frames should be
+// passed to use() every frame it is drawn.
+//
+// A write that finds no room outside the ranges this frame has written or
+// used so far (they have no fence yet, so nothing to wait on) grows the ring:
+// a new buffer at least twice the size is created and the old contents are
+// copied over on the GPU, so id() changes and VAOs pointing at the old buffer
+// have to be re-pointed.
+//
+// Include the GL loader (GLEW or glad) before this header.
+
+#pragma once
+
+#include <cstring>
+#include <deque>
+#include <vector>
+
+class StreamBuffer {
+public:
+    explicit StreamBuffer(GLenum target = GL_ARRAY_BUFFER, size_t capacity = 1 << 20)
+        : target(target) {
+        persistentOk = supportsPersistent();
+        create(capacity);
+    }
+
+    ~StreamBuffer() {
+        for (Fence& f : fences) glDeleteSync(f.sync);
+        release();
+    }
+
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    GLuint id() const { return buf; }
+    size_t capacity() const { return cap; }
+    bool persistent() const { return mapped != nullptr; }
+
+    // Copies `bytes` into the ring and returns the offset of the copy, a
+    // multiple of `align` (any positive value, e.g. a vertex stride so the
+    // offset can be turned into a first vertex)
+    size_t write(const void* data, size_t bytes, size_t align = 16) {
+        size_t offset = reserve(bytes, align);
+        if (mapped) memcpy(mapped + offset, data, bytes);
+        else if (bytes > 0) {
+            glBindBuffer(target, buf);
+            void* p = glMapBufferRange(target, offset, bytes,
+                                       GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+            if (p) {
+                memcpy(p, data, bytes);
+                glUnmapBuffer(target);
+            }
+        }
+        return offset;
+    }
+
+    // Marks a range written in an earlier frame as read by this frame too
+    void use(size_t offset, size_t bytes) {
+        if (bytes > 0) pending.push_back({ offset, offset + bytes });
+    }
+
+    // Call after the draws that read this frame's data have been issued
+    void fence() {
+        if (pending.empty()) return;
+        Fence f;
+        f.ranges.swap(pending);
+        f.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        fences.push_back(f);
+    }
+
+private:
+    struct Range { size_t begin, end; };
+    struct Fence { std::vector<Range> ranges; GLsync sync; };
+
+    GLenum target;
+    GLuint buf = 0;
+    size_t cap = 0, head = 0;
+    unsigned char* mapped = nullptr; // persistent mapping, if any
+    bool persistentOk = false;
+    std::vector<Range> pending;      // read by commands since the last fence
+    std::deque<Fence> fences;
+
+    static bool supportsPersistent() {
+#ifdef GL_MAP_PERSISTENT_BIT
+        GLint major = 0, minor = 0, n = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if (major > 4 || (major == 4 && minor >= 4)) return true;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n);
+        for (GLint i = 0; i < n; i++) {
+            const char* e = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (e && strcmp(e, "GL_ARB_buffer_storage") == 0) return true;
+        }
+#endif
+        return false;
+    }
+
+    void create(size_t bytes) {
+        cap = bytes;
+        glGenBuffers(1, &buf);
+        glBindBuffer(target, buf);
+#ifdef GL_MAP_PERSISTENT_BIT
+        if (persistentOk) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(target, cap, nullptr, flags);
+            mapped = (unsigned char*)glMapBufferRange(target, 0, cap, flags);
+            return;
+        }
+#endif
+        glBufferData(target, cap, nullptr, GL_STREAM_DRAW);
+    }
+
+    void release() {
+        if (!buf) return;
+        if (mapped) {
+            glBindBuffer(target, buf);
+            glUnmapBuffer(target);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &buf);
+        buf = 0;
+    }
+
+    static bool overlaps(const std::vector<Range>& ranges, size_t b, size_t e) {
+        for (const Range& r : ranges)
+            if (r.begin < e && b < r.end) return true;
+        return false;
+    }
+
+    // Blocks until no fenced GPU work reads [b, e); completed fences are dropped
+    void waitFor(size_t b, size_t e) {
+        for (auto it = fences.begin(); it != fences.end();) {
+            bool busy = overlaps(it->ranges, b, e);
+            GLenum r = glClientWaitSync(it->sync, busy ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, 0);
+            while (busy && r == GL_TIMEOUT_EXPIRED)
+                r = glClientWaitSync(it->sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+            if (r == GL_ALREADY_SIGNALED || r == GL_CONDITION_SATISFIED || r == GL_WAIT_FAILED) {
+                glDeleteSync(it->sync);
+                it = fences.erase(it);
+            }
+            else ++it;
+        }
+    }
+
+    // Doubles the ring until `bytes` (plus alignment) fits after the copied
+    // old contents
+    void grow(size_t bytes) {
+        size_t oldCap = cap, newCap = cap * 2;
+        while (newCap < oldCap + bytes) newCap *= 2;
+        GLuint old = buf;
+        unsigned char* oldMapped = mapped;
+        buf = 0;
+        mapped = nullptr;
+        create(newCap);
+        glBindBuffer(GL_COPY_READ_BUFFER, old);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buf);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldCap);
+        if (oldMapped) {
+            glBindBuffer(GL_COPY_READ_BUFFER, old);
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+        }
+        glDeleteBuffers(1, &old); // lives on while VAOs still reference it
+
+        // old fences guarded the old storage; the copy itself now guards
+        // [0, oldCap) of the new one. This frame's ranges stay pending: the
+        // copies at the same offsets are what its later draws read.
+        for (Fence& f : fences) glDeleteSync(f.sync);
+        fences.clear();
+        Fence f;
+        f.ranges.push_back({ 0, oldCap });
+        f.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        fences.push_back(f);
+        head = oldCap;
+    }
+
+    size_t reserve(size_t bytes, size_t align) {
+        size_t offset = (head + align - 1) / align * align;
+        if (offset + bytes > cap) offset = 0; // wrap
+        // a range this frame has already drawn from can't be waited for
+        if (bytes > cap || overlaps(pending, offset, offset + bytes)) {
+            grow(bytes + align);
+            offset = (head + align - 1) / align * align;
+        }
+        waitFor(offset, offset + bytes);
+        head = offset + bytes;
+        pending.push_back({ offset, offset + bytes });
+        return offset;
+    }
+};
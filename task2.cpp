@@ -1,5 +1,7 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "gl_program.h"
+#include "headless.h"
 #include <cmath>
 #include <vector>
 #include <iostream>
@@ -27,32 +29,6 @@ void main() {
 }
 )glsl";
 
-GLuint compileShaderProgram() {
-    auto compile = [](const char* src, GLenum type) {
-        GLuint shader = glCreateShader(type);
-        glShaderSource(shader, 1, &src, nullptr);
-        glCompileShader(shader);
-        GLint success;
-        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-        if (!success) {
-            char info[512];
-            glGetShaderInfoLog(shader, 512, nullptr, info);
-            std::cerr << "Shader compile error:\n" << info << std::endl;
-        }
-        return shader;
-    };
-
-    GLuint vert = compile(vertexShaderSrc, GL_VERTEX_SHADER);
-    GLuint frag = compile(fragmentShaderSrc, GL_FRAGMENT_SHADER);
-    GLuint prog = glCreateProgram();
-    glAttachShader(prog, vert);
-    glAttachShader(prog, frag);
-    glLinkProgram(prog);
-    glDeleteShader(vert);
-    glDeleteShader(frag);
-    return prog;
-}
-
 void createEllipse(std::vector<float>& data, int segments = 50) {
     float cx = -0.6f, cy = 0.5f;
     float rx = 0.2f, ry = 0.15f;
@@ -140,30 +116,43 @@ Shape setupVAO(const std::vector<float>& data, GLenum mode) {
     return s;
 }
 
-int main() {
-    if (!glfwInit()) {
-        std::cerr << "Failed to init GLFW\n";
-        return -1;
-    }
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // for macOS
-
-    GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Task 2 - Four Objects Scene", nullptr, nullptr);
-    if (!window) {
-        std::cerr << "Failed to create window\n";
-        glfwTerminate();
-        return -1;
+int main(int argc, char** argv) {
+    bool offscreen = headless().parse(argc, argv);
+    GLFWwindow* window = nullptr;
+    if (offscreen) {
+        if (!headless().createContext(3, 3, true)) return -1;
+        if (!gladLoadGLLoader((GLADloadproc)HeadlessRun::procAddress)) {
+            std::cerr << "Failed to initialize GLAD\n";
+            return -1;
+        }
+        if (!headless().createTarget(WINDOW_WIDTH, WINDOW_HEIGHT)) return -1;
     }
-    glfwMakeContextCurrent(window);
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        std::cerr << "Failed to initialize GLAD\n";
-        return -1;
+    else {
+        if (!glfwInit()) {
+            std::cerr << "Failed to init GLFW\n";
+            return -1;
+        }
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // for macOS
+
+        window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Task 2 - Four Objects Scene", nullptr, nullptr);
+        if (!window) {
+            std::cerr << "Failed to create window\n";
+            glfwTerminate();
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            std::cerr << "Failed to initialize GLAD\n";
+            return -1;
+        }
     }
 
-    GLuint program = compileShaderProgram();
-    glUseProgram(program);
+    GLProgram program;
+    program.build({ { GL_VERTEX_SHADER, vertexShaderSrc }, { GL_FRAGMENT_SHADER, fragmentShaderSrc } });
+    program.use();
 
     std::vector<float> ellipseData, triData, circleData, squaresData;
     createEllipse(ellipseData);
@@ -178,11 +167,11 @@ int main() {
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
-    while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
+    while (offscreen ? headless().nextFrame() : !glfwWindowShouldClose(window)) {
+        if (!offscreen) glfwPollEvents();
         glClear(GL_COLOR_BUFFER_BIT);
 
-        glUseProgram(program);
+        program.use();
 
         glBindVertexArray(ellipse.vao);
         glDrawArrays(ellipse.mode, 0, ellipse.vertexCount);
@@ -196,16 +185,22 @@ int main() {
         glBindVertexArray(squares.vao);
         for (int i = 0; i < 6; i++)
             glDrawArrays(squares.mode, i * 4, 4);
+        headless().addWork(ellipse.vertexCount - 2 + triangle.vertexCount / 3 + circle.vertexCount - 2 + 6 * 2);
 
-        glfwSwapBuffers(window);
+        if (!offscreen) glfwSwapBuffers(window);
     }
+    if (offscreen) headless().report("task2", "triangles");
 
     GLuint vaos[] = {ellipse.vao, triangle.vao, circle.vao, squares.vao};
     GLuint vbos[] = {ellipse.vbo, triangle.vbo, circle.vbo, squares.vbo};
     glDeleteVertexArrays(4, vaos);
     glDeleteBuffers(4, vbos);
-    glDeleteProgram(program);
+    program.destroy();
 
+    if (offscreen) {
+        headless().destroy();
+        return 0;
+    }
     glfwDestroyWindow(window);
     glfwTerminate();
     return 0;
@@ -0,0 +1,282 @@
+// vec_math.h
+// Vector and matrix maths shared by the programs here, replacing the scalar
+// triple loops and the GLU matrix calls. Matrices are column-major like
+// OpenGL's (element m[col*4 + row]), so they go to glUniformMatrix4fv and
+// glLoadMatrixf unchanged.
+//
+// Mat4 and Mat3 are 16-byte aligned and keep each column in one SSE
+// register: a product is four broadcasts and multiply-adds per column. Mat3
+// pads its columns to four floats, which is also the std140 layout of a
+// mat3 in a uniform block. The batch functions transform arrays of points,
+// normals or matrices four lanes at a time and are what per-object work at
+// large object counts should go through.
+//
+// SSE2 is part of every x86-64 CPU, so there is no runtime dispatch; other
+// targets, or -DVEC_MATH_SCALAR, get the plain loops, which perform the same
+// operations in the same order. Fixed matrices (identity, translation, scale)
+// are constexpr.
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#if !defined(VEC_MATH_SCALAR) && \
+    (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define VEC_MATH_SSE 1
+#include <emmintrin.h>
+#else
+#define VEC_MATH_SSE 0
+#endif
+
+struct Vec3 {
+    float x, y, z;
+    constexpr Vec3() : x(0), y(0), z(0) {}
+    constexpr Vec3(float X, float Y, float Z) : x(X), y(Y), z(Z) {}
+    constexpr Vec3 operator+(const Vec3& o) const { return Vec3(x + o.x, y + o.y, z + o.z); }
+    constexpr Vec3 operator-(const Vec3& o) const { return Vec3(x - o.x, y - o.y, z - o.z); }
+    constexpr Vec3 operator*(float s) const { return Vec3(x * s, y * s, z * s); }
+};
+
+constexpr Vec3 crossp(const Vec3& a, const Vec3& b) {
+    return Vec3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+}
+constexpr float dotp(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline float length(const Vec3& v) { return sqrtf(dotp(v, v)); }
+
+// Unit vector along v, or `fallback` when v is (nearly) zero
+inline Vec3 normalize(const Vec3& v, const Vec3& fallback) {
+    float L = length(v);
+    return (L > 1e-6f) ? Vec3(v.x / L, v.y / L, v.z / L) : fallback;
+}
+inline Vec3 normalize(const Vec3& v) { return normalize(v, v); }
+
+struct alignas(16) Mat4 {
+    float m[16]; // column-major
+
+    constexpr Mat4() : m() {}
+
+    static constexpr Mat4 identity() {
+        Mat4 I;
+        I.m[0] = I.m[5] = I.m[10] = I.m[15] = 1.0f;
+        return I;
+    }
+    static constexpr Mat4 translation(float x, float y, float z) {
+        Mat4 T = identity();
+        T.m[12] = x; T.m[13] = y; T.m[14] = z;
+        return T;
+    }
+    static constexpr Mat4 scale(float x, float y, float z) {
+        Mat4 S;
+        S.m[0] = x; S.m[5] = y; S.m[10] = z; S.m[15] = 1.0f;
+        return S;
+    }
+};
+
+// Upper-left 3x3, columns padded to four floats (std140 mat3)
+struct alignas(16) Mat3 {
+    float m[12]; // column-major, m[col*4 + row]; m[col*4 + 3] unused
+
+    constexpr Mat3() : m() {}
+
+    static constexpr Mat3 identity() {
+        Mat3 I;
+        I.m[0] = I.m[5] = I.m[10] = 1.0f;
+        return I;
+    }
+    Vec3 column(int c) const { return Vec3(m[c * 4], m[c * 4 + 1], m[c * 4 + 2]); }
+    void setColumn(int c, const Vec3& v) {
+        m[c * 4] = v.x; m[c * 4 + 1] = v.y; m[c * 4 + 2] = v.z; m[c * 4 + 3] = 0.0f;
+    }
+};
+
+#if VEC_MATH_SSE
+
+// Column j of the result is A * (column j of B)
+inline void mat4MulSSE(const __m128 a[4], const float* b, float* out) {
+    for (int c = 0; c < 4; c++) {
+        __m128 r = _mm_mul_ps(a[0], _mm_set1_ps(b[c * 4]));
+        r = _mm_add_ps(r, _mm_mul_ps(a[1], _mm_set1_ps(b[c * 4 + 1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a[2], _mm_set1_ps(b[c * 4 + 2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a[3], _mm_set1_ps(b[c * 4 + 3])));
+        _mm_store_ps(out + c * 4, r);
+    }
+}
+
+// Four packed Vec3 (12 floats) to x, y, z registers and back
+inline void vec3LoadSoA(const Vec3* p, __m128& X, __m128& Y, __m128& Z) {
+    const float* f = &p->x;
+    __m128 a = _mm_loadu_ps(f), b = _mm_loadu_ps(f + 4), c = _mm_loadu_ps(f + 8);
+    X = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 1, 2, 2)), _MM_SHUFFLE(2, 0, 3, 0));
+    Y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)),
+                       _MM_SHUFFLE(2, 0, 2, 0));
+    Z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), c, _MM_SHUFFLE(3, 0, 2, 0));
+}
+inline void vec3StoreSoA(Vec3* p, __m128 X, __m128 Y, __m128 Z) {
+    float* f = &p->x;
+    __m128 a = _mm_shuffle_ps(_mm_shuffle_ps(X, Y, _MM_SHUFFLE(0, 0, 0, 0)), _mm_shuffle_ps(Z, X, _MM_SHUFFLE(1, 1, 0, 0)),
+                              _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 b = _mm_shuffle_ps(_mm_shuffle_ps(Y, Z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(X, Y, _MM_SHUFFLE(2, 2, 2, 2)),
+                              _MM_SHUFFLE(2, 0, 2, 0));
+    __m128 c = _mm_shuffle_ps(_mm_shuffle_ps(Z, X, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(Y, Z, _MM_SHUFFLE(3, 3, 3, 3)),
+                              _MM_SHUFFLE(2, 0, 2, 0));
+    _mm_storeu_ps(f, a);
+    _mm_storeu_ps(f + 4, b);
+    _mm_storeu_ps(f + 8, c);
+}
+
+#endif // VEC_MATH_SSE
+
+inline Mat4 operator*(const Mat4& A, const Mat4& B) {
+    Mat4 R;
+#if VEC_MATH_SSE
+    __m128 a[4] = { _mm_load_ps(A.m), _mm_load_ps(A.m + 4), _mm_load_ps(A.m + 8), _mm_load_ps(A.m + 12) };
+    mat4MulSSE(a, B.m, R.m);
+#else
+    for (int c = 0; c < 4; c++)
+        for (int r = 0; r < 4; r++)
+            R.m[c * 4 + r] = A.m[r] * B.m[c * 4] + A.m[4 + r] * B.m[c * 4 + 1] + A.m[8 + r] * B.m[c * 4 + 2] +
+                             A.m[12 + r] * B.m[c * 4 + 3];
+#endif
+    return R;
+}
+
+// out[i] = A * B[i]; e.g. view-projection times every object's model matrix
+inline void mulBatch(const Mat4& A, const Mat4* B, Mat4* out, size_t n) {
+#if VEC_MATH_SSE
+    __m128 a[4] = { _mm_load_ps(A.m), _mm_load_ps(A.m + 4), _mm_load_ps(A.m + 8), _mm_load_ps(A.m + 12) };
+    for (size_t i = 0; i < n; i++) {
+        alignas(16) float r[16]; // B and out may be the same array
+        mat4MulSSE(a, B[i].m, r);
+        for (int c = 0; c < 4; c++) _mm_store_ps(out[i].m + c * 4, _mm_load_ps(r + c * 4));
+    }
+#else
+    for (size_t i = 0; i < n; i++) out[i] = A * B[i];
+#endif
+}
+
+// gluPerspective
+inline Mat4 perspective(float fovyDeg, float aspect, float znear, float zfar) {
+    float f = 1.0f / tanf(fovyDeg * 3.14159265358979f / 360.0f);
+    Mat4 M;
+    M.m[0] = f / aspect;
+    M.m[5] = f;
+    M.m[10] = (zfar + znear) / (znear - zfar);
+    M.m[11] = -1.0f;
+    M.m[14] = (2.0f * zfar * znear) / (znear - zfar);
+    return M;
+}
+
+// gluLookAt
+inline Mat4 lookAt(const Vec3& eye, const Vec3& center, const Vec3& up) {
+    Vec3 f = normalize(center - eye);
+    Vec3 s = normalize(crossp(f, up));
+    Vec3 u = crossp(s, f);
+    Mat4 M = Mat4::identity();
+    M.m[0] = s.x; M.m[4] = s.y; M.m[8]  = s.z;
+    M.m[1] = u.x; M.m[5] = u.y; M.m[9]  = u.z;
+    M.m[2] = -f.x; M.m[6] = -f.y; M.m[10] = -f.z;
+    M.m[12] = -dotp(s, eye);
+    M.m[13] = -dotp(u, eye);
+    M.m[14] = dotp(f, eye);
+    return M;
+}
+
+// glRotatef: angleDeg counter-clockwise about axis
+inline Mat4 rotation(float angleDeg, const Vec3& axis) {
+    Vec3 a = normalize(axis, Vec3(0, 0, 1));
+    float r = angleDeg * 3.14159265358979f / 180.0f, c = cosf(r), s = sinf(r), k = 1.0f - c;
+    Mat4 M = Mat4::identity();
+    M.m[0] = a.x * a.x * k + c;       M.m[4] = a.x * a.y * k - a.z * s; M.m[8]  = a.x * a.z * k + a.y * s;
+    M.m[1] = a.y * a.x * k + a.z * s; M.m[5] = a.y * a.y * k + c;       M.m[9]  = a.y * a.z * k - a.x * s;
+    M.m[2] = a.z * a.x * k - a.y * s; M.m[6] = a.z * a.y * k + a.x * s; M.m[10] = a.z * a.z * k + c;
+    return M;
+}
+
+inline Mat3 upperLeft3(const Mat4& M) {
+    Mat3 R;
+    for (int c = 0; c < 3; c++) R.setColumn(c, Vec3(M.m[c * 4], M.m[c * 4 + 1], M.m[c * 4 + 2]));
+    return R;
+}
+
+inline Mat3 transpose(const Mat3& M) {
+    Mat3 R;
+    for (int c = 0; c < 3; c++) R.setColumn(c, Vec3(M.m[c], M.m[4 + c], M.m[8 + c]));
+    return R;
+}
+
+// The rows of the inverse are the cross products of pairs of columns over
+// the determinant; false (and out untouched) when M is singular
+inline bool inverse(const Mat3& M, Mat3& out) {
+    Vec3 c0 = M.column(0), c1 = M.column(1), c2 = M.column(2);
+    Vec3 r0 = crossp(c1, c2), r1 = crossp(c2, c0), r2 = crossp(c0, c1);
+    float det = dotp(c0, r0);
+    if (fabsf(det) < 1e-12f) return false;
+    float k = 1.0f / det;
+    out.setColumn(0, Vec3(r0.x, r1.x, r2.x) * k);
+    out.setColumn(1, Vec3(r0.y, r1.y, r2.y) * k);
+    out.setColumn(2, Vec3(r0.z, r1.z, r2.z) * k);
+    return true;
+}
+
+// Inverse-transpose of the upper-left 3x3, for normals; the 3x3 itself
+// when it is singular
+inline Mat3 normalMatrix(const Mat4& M) {
+    Mat3 A = upperLeft3(M), inv;
+    return inverse(A, inv) ? transpose(inv) : A;
+}
+
+inline Vec3 transformPoint(const Mat4& M, const Vec3& p) {
+    return Vec3((M.m[0] * p.x + M.m[4] * p.y) + (M.m[8] * p.z + M.m[12]),
+                (M.m[1] * p.x + M.m[5] * p.y) + (M.m[9] * p.z + M.m[13]),
+                (M.m[2] * p.x + M.m[6] * p.y) + (M.m[10] * p.z + M.m[14]));
+}
+
+inline Vec3 transformVector(const Mat3& M, const Vec3& v) {
+    return Vec3((M.m[0] * v.x + M.m[4] * v.y) + M.m[8] * v.z,
+                (M.m[1] * v.x + M.m[5] * v.y) + M.m[9] * v.z,
+                (M.m[2] * v.x + M.m[6] * v.y) + M.m[10] * v.z);
+}
+
+// out[i] = M * (in[i], 1), dropping w (affine M); in and out may alias
+inline void transformPoints(const Mat4& M, const Vec3* in, Vec3* out, size_t n) {
+    size_t i = 0;
+#if VEC_MATH_SSE
+    __m128 m[12];
+    for (int k = 0; k < 12; k++) m[k] = _mm_set1_ps(M.m[(k / 3) * 4 + k % 3]);
+    for (; i + 4 <= n; i += 4) {
+        __m128 X, Y, Z;
+        vec3LoadSoA(in + i, X, Y, Z);
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], X), _mm_mul_ps(m[3], Y)), _mm_add_ps(_mm_mul_ps(m[6], Z), m[9]));
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1], X), _mm_mul_ps(m[4], Y)), _mm_add_ps(_mm_mul_ps(m[7], Z), m[10]));
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[2], X), _mm_mul_ps(m[5], Y)), _mm_add_ps(_mm_mul_ps(m[8], Z), m[11]));
+        vec3StoreSoA(out + i, x, y, z);
+    }
+#endif
+    for (; i < n; i++) out[i] = transformPoint(M, in[i]);
+}
+
+// out[i] = N * in[i], renormalised (pass normalMatrix(model)); in and out
+// may alias
+inline void transformNormals(const Mat3& N, const Vec3* in, Vec3* out, size_t n) {
+    size_t i = 0;
+#if VEC_MATH_SSE
+    __m128 m[9];
+    for (int k = 0; k < 9; k++) m[k] = _mm_set1_ps(N.m[(k / 3) * 4 + k % 3]);
+    const __m128 eps = _mm_set1_ps(1e-6f);
+    for (; i + 4 <= n; i += 4) {
+        __m128 X, Y, Z;
+        vec3LoadSoA(in + i, X, Y, Z);
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[0], X), _mm_mul_ps(m[3], Y)), _mm_mul_ps(m[6], Z));
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[1], X), _mm_mul_ps(m[4], Y)), _mm_mul_ps(m[7], Z));
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[2], X), _mm_mul_ps(m[5], Y)), _mm_mul_ps(m[8], Z));
+        __m128 L = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+        __m128 ok = _mm_cmpgt_ps(L, eps);
+        x = _mm_or_ps(_mm_and_ps(ok, _mm_div_ps(x, L)), _mm_andnot_ps(ok, x));
+        y = _mm_or_ps(_mm_and_ps(ok, _mm_div_ps(y, L)), _mm_andnot_ps(ok, y));
+        z = _mm_or_ps(_mm_and_ps(ok, _mm_div_ps(z, L)), _mm_andnot_ps(ok, z));
+        vec3StoreSoA(out + i, x, y, z);
+    }
+#endif
+    for (; i < n; i++) out[i] = normalize(transformVector(N, in[i]));
+}
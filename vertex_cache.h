@@ -0,0 +1,128 @@
+// vertex_cache.h
+// Triangle order for the post-transform vertex cache. optimizeVertexCache()
+// reorders an indexed triangle list with Tom Forsyth's "linear-speed vertex
+// cache optimisation": it keeps a model LRU cache of the last 32 vertices
+// used, scores every vertex by its place in that cache and by how few
+// triangles still need it, and always emits the remaining triangle with the
+// highest score among those touching the cache. Triangles keep their winding
+// and only their order changes, so the mesh draws the same image.
+//
+// acmr() is the figure of merit: vertex shader runs per triangle through a
+// FIFO cache of the given size, the way most GPUs reuse transformed vertices.
+// 3 is no reuse at all, 0.5 the limit for a large regular grid; row-by-row
+// grids wider than the cache sit near 1.
+//
+// No GL calls.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Shader invocations per triangle with a FIFO cache of cacheSize vertices
+inline float acmr(const std::vector<unsigned int>& inds, size_t vertexCount, int cacheSize = 16) {
+    if (inds.size() < 3) return 0.0f;
+    std::vector<size_t> stamp(vertexCount, 0); // misses so far when the vertex entered the cache; 0 never
+    size_t misses = 0;
+    for (unsigned int v : inds)
+        if (stamp[v] == 0 || misses - stamp[v] >= (size_t)cacheSize) stamp[v] = ++misses;
+    return (float)misses / (float)(inds.size() / 3);
+}
+
+namespace vertex_cache_detail {
+
+const int CACHE_SIZE = 32;
+
+inline float vertexScore(int cachePos, int remaining) {
+    if (remaining == 0) return -1.0f; // nothing left to draw with it
+    float score = 0.0f;
+    if (cachePos >= 0) {
+        // the last triangle's vertices score the same, so there is no bias
+        // towards one of its edges
+        if (cachePos < 3) score = 0.75f;
+        else score = powf(1.0f - (cachePos - 3) / (float)(CACHE_SIZE - 3), 1.5f);
+    }
+    // favour vertices with few triangles left, to finish them off
+    return score + 2.0f / sqrtf((float)remaining);
+}
+
+} // namespace vertex_cache_detail
+
+inline void optimizeVertexCache(std::vector<unsigned int>& inds, size_t vertexCount) {
+    using namespace vertex_cache_detail;
+    size_t triCount = inds.size() / 3;
+    if (triCount == 0) return;
+
+    // triangles of each vertex; the first `remaining[v]` of its list still
+    // need drawing
+    std::vector<unsigned int> firstTri(vertexCount + 1, 0), remaining(vertexCount, 0);
+    for (unsigned int v : inds) remaining[v]++;
+    for (size_t v = 0; v < vertexCount; v++) firstTri[v + 1] = firstTri[v] + remaining[v];
+    std::vector<unsigned int> vertexTris(inds.size()), fill(firstTri.begin(), firstTri.end() - 1);
+    for (size_t t = 0; t < triCount; t++)
+        for (int c = 0; c < 3; c++) vertexTris[fill[inds[3 * t + c]]++] = (unsigned int)t;
+
+    std::vector<int> cachePos(vertexCount, -1);
+    std::vector<float> score(vertexCount), triScore(triCount);
+    for (size_t v = 0; v < vertexCount; v++) score[v] = vertexScore(-1, remaining[v]);
+    for (size_t t = 0; t < triCount; t++)
+        triScore[t] = score[inds[3 * t]] + score[inds[3 * t + 1]] + score[inds[3 * t + 2]];
+    std::vector<bool> emitted(triCount, false);
+
+    std::vector<unsigned int> out;
+    out.reserve(inds.size());
+    std::vector<unsigned int> cache, next;
+    size_t cursor = 0; // every triangle before it has been emitted
+    long best = -1;
+    while (out.size() < inds.size()) {
+        if (best < 0) {
+            // nothing in the cache touches a remaining triangle: start anew
+            while (emitted[cursor]) cursor++;
+            best = (long)cursor;
+        }
+        const unsigned int* tri = &inds[3 * best];
+        out.insert(out.end(), tri, tri + 3);
+        emitted[best] = true;
+
+        // drop the triangle from its vertices' lists
+        for (int c = 0; c < 3; c++) {
+            unsigned int v = tri[c];
+            unsigned int* list = &vertexTris[firstTri[v]];
+            unsigned int n = remaining[v]--;
+            for (unsigned int k = 0; k < n; k++)
+                if (list[k] == (unsigned int)best) {
+                    std::swap(list[k], list[n - 1]);
+                    break;
+                }
+        }
+
+        // its vertices move to the front of the cache, and some fall out
+        next.assign(tri, tri + 3);
+        for (unsigned int v : cache)
+            if (v != tri[0] && v != tri[1] && v != tri[2]) next.push_back(v);
+        for (size_t k = 0; k < next.size(); k++) {
+            unsigned int v = next[k];
+            cachePos[v] = k < (size_t)CACHE_SIZE ? (int)k : -1;
+            float s = vertexScore(cachePos[v], remaining[v]);
+            float delta = s - score[v];
+            score[v] = s;
+            for (unsigned int i = 0; i < remaining[v]; i++) triScore[vertexTris[firstTri[v] + i]] += delta;
+        }
+        if (next.size() > (size_t)CACHE_SIZE) next.resize(CACHE_SIZE);
+        cache.swap(next);
+
+        // the best remaining triangle touching the cache
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache)
+            for (unsigned int i = 0; i < remaining[v]; i++) {
+                unsigned int t = vertexTris[firstTri[v] + i];
+                if (triScore[t] > bestScore) {
+                    bestScore = triScore[t];
+                    best = (long)t;
+                }
+            }
+    }
+    inds.swap(out);
+}